@@ -0,0 +1,350 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderancestorindex.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace cumulus
+{
+
+// Bump this if the file layout changes. Older files are then replaced.
+static const quint32 indexFileVersion = 2;
+
+// The records of the file, each a type and what follows
+static const quint8 entryRecord = 1;
+static const quint8 removalRecord = 2;
+
+// The file is written from scratch once it is this big, and twice as big
+// as when it was last written from scratch
+static const qint64 minCompactSize = 1024 * 1024;
+
+// Girder folders cannot be nested this deep in practice. This guards
+// against cycles from stale entries after a folder was moved.
+static const int maxDepth = 256;
+
+GirderAncestorIndex::GirderAncestorIndex()
+  : m_filePrefix("ancestors")
+{
+}
+
+GirderAncestorIndex::GirderAncestorIndex(const QString& filePrefix)
+  : m_filePrefix(filePrefix)
+{
+}
+
+GirderAncestorIndex::~GirderAncestorIndex()
+{
+  save();
+}
+
+void GirderAncestorIndex::setApiUrl(const QString& apiUrl)
+{
+  if (apiUrl == m_apiUrl)
+    return;
+
+  save();
+  m_apiUrl = apiUrl;
+  m_entries.clear();
+  m_changed.clear();
+  clearRecords();
+  load();
+}
+
+QString GirderAncestorIndex::fileName() const
+{
+  QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+  QByteArray hash = QCryptographicHash::hash(m_apiUrl.toUtf8(), QCryptographicHash::Sha1);
+  return dir + "/girderfilebrowser/" + m_filePrefix + "-" + QString::fromLatin1(hash.toHex()) +
+    ".dat";
+}
+
+bool GirderAncestorIndex::readRecord(quint8, QDataStream&)
+{
+  return false;
+}
+
+void GirderAncestorIndex::writeRecords(QDataStream&, bool)
+{
+}
+
+void GirderAncestorIndex::load()
+{
+  m_fileValid = false;
+  m_fileSize = 0;
+  m_compactedSize = 0;
+  if (m_apiUrl.isEmpty())
+    return;
+
+  QFile file(fileName());
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  QDataStream stream(&file);
+  quint32 version = 0;
+  stream >> version;
+  if (version != indexFileVersion)
+    return;
+
+  // A writer that did not finish may have left part of a record at the
+  // end. The records before it are kept.
+  while (!stream.atEnd())
+  {
+    quint8 type = 0;
+    stream >> type;
+
+    QString id;
+    if (type == entryRecord)
+    {
+      Entry entry;
+      stream >> id >> entry.name >> entry.type >> entry.parentId >> entry.parentType >>
+        entry.size >> entry.updated;
+      if (stream.status() != QDataStream::Ok)
+        break;
+      m_entries.insert(id, entry);
+    }
+    else if (type == removalRecord)
+    {
+      stream >> id;
+      if (stream.status() != QDataStream::Ok)
+        break;
+      m_entries.remove(id);
+    }
+    else if (!readRecord(type, stream) || stream.status() != QDataStream::Ok)
+    {
+      break;
+    }
+  }
+
+  // Anything appended after a bad record could not be read back, so the
+  // file is written from scratch instead
+  m_fileValid = stream.status() == QDataStream::Ok && stream.atEnd();
+  if (!m_fileValid)
+    qDebug() << "Ignoring the rest of corrupt index" << file.fileName();
+
+  m_fileSize = file.size();
+  m_compactedSize = m_fileSize;
+
+  for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+    entryChanged(it.key());
+}
+
+void GirderAncestorIndex::save()
+{
+  if (m_apiUrl.isEmpty())
+    return;
+
+  // Another process may have removed the file since
+  if (!m_fileValid || !QFileInfo::exists(fileName()) ||
+      (m_fileSize > minCompactSize && m_fileSize > 2 * m_compactedSize))
+  {
+    if (rewrite())
+      m_changed.clear();
+    return;
+  }
+
+  QByteArray records;
+  QDataStream stream(&records, QIODevice::WriteOnly);
+  for (const QString& id : m_changed)
+  {
+    auto it = m_entries.constFind(id);
+    if (it == m_entries.cend())
+    {
+      stream << removalRecord << id;
+      continue;
+    }
+
+    const Entry& entry = it.value();
+    stream << entryRecord << id << entry.name << entry.type << entry.parentId
+           << entry.parentType << entry.size << entry.updated;
+  }
+  writeRecords(stream, false);
+
+  if (records.isEmpty())
+    return;
+
+  // The records are written at once, so that they end up in one piece
+  QFile file(fileName());
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Append) ||
+      file.write(records) != records.size() || !file.flush())
+  {
+    // What the file holds is not known anymore
+    m_fileValid = false;
+    return;
+  }
+
+  m_changed.clear();
+  m_fileSize = file.size();
+}
+
+bool GirderAncestorIndex::rewrite()
+{
+  QString name = fileName();
+  QDir().mkpath(QFileInfo(name).absolutePath());
+
+  // Write to a temporary file first, so that a crash cannot leave a
+  // truncated index behind
+  QSaveFile file(name);
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  QDataStream stream(&file);
+  stream << indexFileVersion;
+  for (auto it = m_entries.cbegin(); it != m_entries.cend(); ++it)
+  {
+    const Entry& entry = it.value();
+    stream << entryRecord << it.key() << entry.name << entry.type << entry.parentId
+           << entry.parentType << entry.size << entry.updated;
+  }
+  writeRecords(stream, true);
+
+  if (!file.commit())
+    return false;
+
+  m_fileValid = true;
+  m_fileSize = QFileInfo(name).size();
+  m_compactedSize = m_fileSize;
+  return true;
+}
+
+void GirderAncestorIndex::remove(const QString& id)
+{
+  if (m_entries.remove(id) == 0)
+    return;
+
+  m_changed.insert(id);
+  entryChanged(id);
+}
+
+void GirderAncestorIndex::insert(const QString& id, const Entry& entry)
+{
+  if (id.isEmpty())
+    return;
+
+  Entry inserted = entry;
+  auto it = m_entries.find(id);
+  if (it != m_entries.end())
+  {
+    if (inserted.size < 0 && inserted.updated.isEmpty())
+    {
+      inserted.size = it->size;
+      inserted.updated = it->updated;
+    }
+
+    if (it->name == inserted.name && it->type == inserted.type &&
+        it->parentId == inserted.parentId && it->parentType == inserted.parentType &&
+        it->size == inserted.size && it->updated == inserted.updated)
+    {
+      return;
+    }
+  }
+
+  m_entries.insert(id, inserted);
+  m_changed.insert(id);
+  entryChanged(id);
+}
+
+void GirderAncestorIndex::addChildren(const QMap<QString, QString>& parentInfo,
+  const QString& childType,
+  const GirderListing& children)
+{
+  for (int row = 0; row < children.size(); ++row)
+  {
+    Entry entry;
+    entry.name = children.value(row);
+    entry.type = childType;
+    entry.parentId = parentInfo.value("id");
+    entry.parentType = parentInfo.value("type");
+    insert(children.key(row), entry);
+  }
+}
+
+void GirderAncestorIndex::addRootPath(const QList<QMap<QString, QString> >& rootPath,
+  const QMap<QString, QString>& object)
+{
+  QList<QMap<QString, QString> > chain = rootPath;
+  chain.append(object);
+
+  // The top of a root path from the server is a user or a collection
+  QMap<QString, QString> parentInfo;
+  for (const auto& link : chain)
+  {
+    Entry entry;
+    entry.name = link.value("name");
+    entry.type = link.value("type");
+    entry.parentId = parentInfo.value("id");
+    entry.parentType = parentInfo.value("type");
+    insert(link.value("id"), entry);
+    parentInfo = link;
+  }
+}
+
+bool GirderAncestorIndex::rootPath(const QMap<QString, QString>& object,
+  QList<QMap<QString, QString> >& rootPath,
+  QMap<QString, QString>& missing,
+  const QString& stopAtId) const
+{
+  rootPath.clear();
+  missing.clear();
+
+  QMap<QString, QString> current = object;
+  for (int depth = 0; depth < maxDepth; ++depth)
+  {
+    if (!stopAtId.isEmpty() && current.value("id") == stopAtId && depth > 0)
+      return true;
+
+    // Users and collections are at the top
+    QString type = current.value("type");
+    if (type == "user" || type == "collection")
+      return true;
+
+    auto it = m_entries.constFind(current.value("id"));
+    if (it == m_entries.cend() || it->parentId.isEmpty())
+    {
+      missing = current;
+      if (depth > 0)
+        rootPath.pop_front();
+      return false;
+    }
+
+    QMap<QString, QString> parentInfo;
+    parentInfo["type"] = it->parentType;
+    parentInfo["id"] = it->parentId;
+    auto parentIt = m_entries.constFind(it->parentId);
+    if (parentIt != m_entries.cend())
+      parentInfo["name"] = parentIt->name;
+
+    // Without a name, the parent is only known as a link
+    if (!parentInfo.contains("name"))
+    {
+      missing = current;
+      if (depth > 0)
+        rootPath.pop_front();
+      return false;
+    }
+
+    rootPath.prepend(parentInfo);
+    current = parentInfo;
+  }
+
+  // A cycle. Let the server sort it out.
+  rootPath.clear();
+  missing = object;
+  return false;
+}
+
+} // end namespace
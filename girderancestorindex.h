@@ -0,0 +1,138 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderancestorindex.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderancestorindex_h
+#define girderfilebrowser_girderancestorindex_h
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QSet>
+#include <QString>
+
+#include "girderlisting.h"
+
+class QDataStream;
+
+namespace cumulus
+{
+
+// Remembers the name, type and parent of every girder object that was
+// seen in a listing or a root path, so that root paths can be built
+// without asking the server. The index of each server is kept in a file
+// in the user's cache directory between sessions.
+//
+// The file is only appended to: save() writes the entries that changed
+// since the last save, and a later record for an object replaces an
+// earlier one. Once the file is mostly replaced records, it is written
+// again from scratch.
+class GirderAncestorIndex
+{
+public:
+  struct Entry
+  {
+    QString name;
+    QString type;
+    QString parentId;
+    QString parentType;
+    // Only known from some listings. In bytes, or -1 if unknown.
+    qint64 size = -1;
+    // As the server formats it
+    QString updated;
+  };
+
+  GirderAncestorIndex();
+  virtual ~GirderAncestorIndex();
+
+  // Save the current index, if any, and load the one of apiUrl
+  void setApiUrl(const QString& apiUrl);
+
+  // Append what changed to the file of the index
+  void save();
+
+  // The objects of a listing of parentInfo, as <id => name>. Users and
+  // collections have no parent, so parentInfo is empty for them.
+  void addChildren(const QMap<QString, QString>& parentInfo,
+    const QString& childType,
+    const GirderListing& children);
+
+  // A root path from the server. Every entry is the parent of the next
+  // one, and the last entry is the parent of object.
+  void addRootPath(const QList<QMap<QString, QString> >& rootPath,
+    const QMap<QString, QString>& object);
+
+  // Build the root path of object, from the user or collection at the top
+  // down to its parent, with "type", "id", and "name" for every entry.
+  // The path is also complete once it reaches stopAtId, if set.
+  //
+  // Returns true if every link is known. Otherwise, missing is the highest
+  // known ancestor (possibly object itself) whose parent is unknown, and
+  // rootPath holds the known part of the path below missing.
+  bool rootPath(const QMap<QString, QString>& object,
+    QList<QMap<QString, QString> >& rootPath,
+    QMap<QString, QString>& missing,
+    const QString& stopAtId = QString()) const;
+
+  // Forget an object that was removed or moved away
+  void remove(const QString& id);
+
+  bool contains(const QString& id) const { return m_entries.contains(id); }
+  Entry entry(const QString& id) const { return m_entries.value(id); }
+  const QHash<QString, Entry>& entries() const { return m_entries; }
+  int size() const { return m_entries.size(); }
+
+protected:
+  // An index of its own, in a file named after filePrefix
+  explicit GirderAncestorIndex(const QString& filePrefix);
+
+  // Entries without a size or an update time keep the known ones
+  void insert(const QString& id, const Entry& entry);
+
+  // Subclasses may keep records of their own in the file, of types from
+  // userRecord on. They are read back with readRecord(), which returns
+  // false for an unknown type. writeRecords() writes those that changed
+  // since the last save, or all of them if all is set. Subclasses that
+  // write records have to save() in their own destructor.
+  static const quint8 userRecord = 16;
+  virtual bool readRecord(quint8 type, QDataStream& stream);
+  virtual void writeRecords(QDataStream& stream, bool all);
+  // Forget the records of the subclass, before the index of another
+  // server is loaded
+  virtual void clearRecords() {}
+
+  // Called for every entry that is added, changed or removed, including
+  // those loaded from the file
+  virtual void entryChanged(const QString&) {}
+
+private:
+  QString fileName() const;
+  void load();
+  // Write every entry to a new file
+  bool rewrite();
+
+  QString m_filePrefix;
+  QString m_apiUrl;
+  QHash<QString, Entry> m_entries;
+  // The objects added or removed since the last save
+  QSet<QString> m_changed;
+
+  // Whether the file can be appended to, its size, and its size when it
+  // was loaded or last written from scratch
+  bool m_fileValid = false;
+  qint64 m_fileSize = 0;
+  qint64 m_compactedSize = 0;
+};
+
+} // end namespace
+
+#endif
@@ -9,18 +9,23 @@
 //=========================================================================
 
 #include <QByteArray>
+#include <QDateTime>
 #include <QDebug>
 #include <QList>
 #include <QNetworkAccessManager>
 #include <QNetworkCookie>
 #include <QNetworkReply>
 #include <QNetworkRequest>
+#include <QSslConfiguration>
 #include <QString>
+#include <QTimer>
 #include <QUrl>
 #include <QUrlQuery>
 #include <QVariant>
 
 #include "girderauthenticator.h"
+#include "girderrequest.h"
+#include "girdersessioncache.h"
 
 namespace cumulus
 {
@@ -39,6 +44,10 @@ void GirderAuthenticator::authenticateApiKey(const QString& apiUrl, const QStrin
   if (m_pendingReply)
     return;
 
+  // Resume the previous TLS session, and keep the new one for next time
+  if (m_sessionCache)
+    GirderRequest::setTlsSession(apiUrl, m_sessionCache->sessionTicket(apiUrl));
+
   static const QString& tokenDuration = "90";
 
   QByteArray postData;
@@ -49,6 +58,7 @@ void GirderAuthenticator::authenticateApiKey(const QString& apiUrl, const QStrin
 
   QNetworkRequest request(url);
   request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
+  GirderRequest::applyTransportProfile(request);
 
   // No more authentication requests can be sent until m_pendingReply is null
   m_pendingReply.reset(m_networkManager->post(request, postData));
@@ -70,6 +80,10 @@ void GirderAuthenticator::authenticatePassword(const QString& apiUrl,
   if (m_pendingReply)
     return;
 
+  // Resume the previous TLS session, and keep the new one for next time
+  if (m_sessionCache)
+    GirderRequest::setTlsSession(apiUrl, m_sessionCache->sessionTicket(apiUrl));
+
   QUrl url(QString("%1/user/authentication").arg(apiUrl));
 
   // Basic http authentication scheme
@@ -80,6 +94,7 @@ void GirderAuthenticator::authenticatePassword(const QString& apiUrl,
   QNetworkRequest request(url);
   request.setHeader(QNetworkRequest::ContentTypeHeader, "application/x-www-form-urlencoded");
   request.setRawHeader("Authorization", headerData.toLocal8Bit());
+  GirderRequest::applyTransportProfile(request);
 
   // No more authentication requests can be sent until m_pendingReply is null
   m_pendingReply.reset(m_networkManager->get(request));
@@ -103,6 +118,7 @@ void GirderAuthenticator::finishAuthentication()
   std::unique_ptr<QNetworkReply> reply = std::move(m_pendingReply);
 
   QString girderToken;
+  QDateTime expiry;
   QString errorMessage;
 
   QByteArray bytes = reply->readAll();
@@ -122,6 +138,7 @@ void GirderAuthenticator::finishAuthentication()
       if (cookie.name() == "girderToken")
       {
         girderToken = cookie.value();
+        expiry = cookie.expirationDate();
       }
     }
 
@@ -140,7 +157,91 @@ void GirderAuthenticator::finishAuthentication()
     return;
   }
 
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+  emit transportNegotiated(reply->attribute(QNetworkRequest::HTTP2WasUsedAttribute).toBool());
+#endif
+
+  if (m_sessionCache && expiry.isValid())
+  {
+    QByteArray sessionTicket;
+#ifndef QT_NO_SSL
+    sessionTicket = reply->sslConfiguration().sessionTicket();
+#endif
+    m_sessionCache->store(apiUrl, girderToken, expiry, sessionTicket);
+  }
+
+  if (GirderRequest::transportProfile() == GirderRequest::TransportProfile::http2)
+    warmUpConnections(apiUrl);
+
   emit authenticationSucceeded(apiUrl, girderToken);
 }
 
+bool GirderAuthenticator::authenticateCachedSession(const QString& apiUrl)
+{
+  if (!m_sessionCache || m_pendingReply)
+    return false;
+
+  QString girderToken = m_sessionCache->token(apiUrl);
+  if (girderToken.isEmpty())
+    return false;
+
+  m_apiUrl = apiUrl;
+  GirderRequest::setTlsSession(apiUrl, m_sessionCache->sessionTicket(apiUrl));
+
+  // The first listing is the first round trip, so have the connection
+  // ready for it.
+  warmUpConnections(apiUrl);
+
+  // Emit from the event loop, like the other authentication methods, so
+  // that the caller can finish its connections first.
+  QTimer::singleShot(
+    0, this, [this, apiUrl, girderToken]() { emit authenticationSucceeded(apiUrl, girderToken); });
+  return true;
+}
+
+void GirderAuthenticator::forgetCachedSession()
+{
+  if (m_sessionCache && !m_apiUrl.isEmpty())
+    m_sessionCache->clear(m_apiUrl);
+}
+
+static void warmUpConnection(QNetworkAccessManager* networkManager, const QUrl& url)
+{
+  if (url.scheme() != "https")
+  {
+    networkManager->connectToHost(url.host(), static_cast<quint16>(url.port(80)));
+    return;
+  }
+
+#ifndef QT_NO_SSL
+  QSslConfiguration sslConfiguration = GirderRequest::sslConfiguration(url);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 10, 0)
+  // Offer HTTP/2 during the handshake so the connection can be reused
+  // by requests that allow it.
+  if (GirderRequest::transportProfile() == GirderRequest::TransportProfile::http2)
+  {
+    sslConfiguration.setAllowedNextProtocols({ QSslConfiguration::ALPNProtocolHTTP2,
+      QSslConfiguration::NextProtocolHttp1_1 });
+  }
+#endif
+  networkManager->connectToHostEncrypted(
+    url.host(), static_cast<quint16>(url.port(443)), sslConfiguration);
+#endif
+}
+
+void GirderAuthenticator::warmUpConnections(const QString& apiUrl)
+{
+  QUrl url(apiUrl);
+  if (!url.isValid() || url.host().isEmpty())
+    return;
+
+  warmUpConnection(m_networkManager, url);
+
+  if (GirderNetworkManagerPool* pool = GirderRequest::networkManagerPool())
+  {
+    for (QNetworkAccessManager* networkManager : pool->managers())
+      warmUpConnection(networkManager, url);
+  }
+}
+
 } // end namespace
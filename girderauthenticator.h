@@ -25,6 +25,8 @@ class QNetworkReply;
 namespace cumulus
 {
 
+class GirderSessionCache;
+
 class GirderAuthenticator : public QObject
 {
   Q_OBJECT
@@ -38,16 +40,38 @@ public:
   void authenticateApiKey(const QString& apiUrl, const QString& apiKey);
   void authenticatePassword(const QString& apiUrl, const QString& username, const QString& password);
 
+  // If a session cache is set, successful authentications are stored in
+  // it, and authenticateCachedSession() can reuse them. It is not owned.
+  void setSessionCache(GirderSessionCache* cache) { m_sessionCache = cache; }
+
+  // If the session cache has a token for apiUrl that has not expired,
+  // emit authenticationSucceeded() with it without contacting the server,
+  // and return true. The server may still reject the token, in which case
+  // call forgetCachedSession() and authenticate again.
+  bool authenticateCachedSession(const QString& apiUrl);
+  void forgetCachedSession();
+
+  // Open connections to the server ahead of the first request, so that the
+  // first listing does not pay for the handshakes. This is done
+  // automatically after a successful authentication when the transport
+  // profile is http2. It covers the network manager pool too, if one is set.
+  void warmUpConnections(const QString& apiUrl);
+
 signals:
   void authenticationSucceeded(const QString& apiUrl, const QString& girderToken);
   void authenticationErrored(const QString& errorMessage);
 
+  // Emitted after authentication with whether the server agreed to
+  // HTTP/2, so that requests can be multiplexed. Requires Qt 5.9 or newer.
+  void transportNegotiated(bool multiplexed);
+
 private slots:
   void finishAuthentication();
 
 private:
   QNetworkAccessManager* m_networkManager;
   QString m_apiUrl;
+  GirderSessionCache* m_sessionCache = nullptr;
   std::unique_ptr<QNetworkReply> m_pendingReply;
 };
 
@@ -0,0 +1,110 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderconcurrencylimiter.h"
+
+#include <QCoreApplication>
+
+#include <algorithm>
+
+namespace cumulus
+{
+
+GirderConcurrencyLimiter::GirderConcurrencyLimiter(QObject* parent)
+  : QObject(parent)
+{
+}
+
+GirderConcurrencyLimiter::~GirderConcurrencyLimiter() = default;
+
+GirderConcurrencyLimiter* GirderConcurrencyLimiter::bulkLimiter()
+{
+  // Parent it to the application so that it is deleted with it
+  static GirderConcurrencyLimiter* limiter =
+    new GirderConcurrencyLimiter(QCoreApplication::instance());
+  return limiter;
+}
+
+void GirderConcurrencyLimiter::setMinWindow(double window)
+{
+  m_minWindow = std::max(window, 1.0);
+  m_window = std::max(m_window, m_minWindow);
+  startQueued();
+}
+
+void GirderConcurrencyLimiter::setMaxWindow(double window)
+{
+  m_maxWindow = std::max(window, m_minWindow);
+  m_window = std::min(m_window, m_maxWindow);
+  emit windowChanged(m_window, m_inFlight, queued());
+}
+
+void GirderConcurrencyLimiter::acquire(QObject* context, std::function<void()> start)
+{
+  m_queue.emplace_back(QPointer<QObject>(context), std::move(start));
+  startQueued();
+}
+
+void GirderConcurrencyLimiter::release(qint64 latencyMsecs, bool congested)
+{
+  m_inFlight = std::max(m_inFlight - 1, 0);
+
+  if (latencyMsecs >= 0)
+  {
+    bool slow = m_smoothedLatency > 0 &&
+      latencyMsecs > m_latencyTolerance * m_smoothedLatency;
+
+    if (m_smoothedLatency < 0)
+      m_smoothedLatency = latencyMsecs;
+    else
+      m_smoothedLatency = 0.875 * m_smoothedLatency + 0.125 * latencyMsecs;
+
+    if (congested || slow)
+    {
+      // Only decrease once per round trip, since a burst of errors is
+      // usually caused by one overload.
+      if (!m_sinceDecrease.isValid() || m_sinceDecrease.elapsed() > m_smoothedLatency)
+      {
+        m_window = std::max(m_window / 2.0, m_minWindow);
+        m_sinceDecrease.restart();
+      }
+    }
+    else
+    {
+      m_window = std::min(m_window + 1.0 / m_window, m_maxWindow);
+    }
+  }
+
+  emit windowChanged(m_window, m_inFlight, queued());
+  startQueued();
+}
+
+void GirderConcurrencyLimiter::startQueued()
+{
+  bool started = false;
+  while (!m_queue.empty() && m_inFlight < static_cast<int>(m_window))
+  {
+    auto next = std::move(m_queue.front());
+    m_queue.pop_front();
+
+    // The requester went away while it was waiting
+    if (!next.first)
+      continue;
+
+    ++m_inFlight;
+    started = true;
+    next.second();
+  }
+
+  if (started)
+    emit windowChanged(m_window, m_inFlight, queued());
+}
+
+} // end namespace
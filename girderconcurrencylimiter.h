@@ -0,0 +1,94 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderconcurrencylimiter.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderconcurrencylimiter_h
+#define girderfilebrowser_girderconcurrencylimiter_h
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+
+#include <deque>
+#include <functional>
+
+namespace cumulus
+{
+
+// Limits how many requests are in flight at once. The window adapts with
+// additive increase and multiplicative decrease (AIMD): every successful
+// reply grows it by 1 / window (about one more request per round trip),
+// and transient errors or latency spikes halve it, at most once per
+// round trip.
+class GirderConcurrencyLimiter : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit GirderConcurrencyLimiter(QObject* parent = nullptr);
+  virtual ~GirderConcurrencyLimiter() override;
+
+  // Shared by the bulk operations of the whole process: folder downloads,
+  // file bumping, and recursive listings.
+  static GirderConcurrencyLimiter* bulkLimiter();
+
+  void setMinWindow(double window);
+  double minWindow() const { return m_minWindow; }
+
+  void setMaxWindow(double window);
+  double maxWindow() const { return m_maxWindow; }
+
+  // A reply that takes this many times longer than the smoothed latency
+  // is treated as a sign of congestion.
+  void setLatencyTolerance(double tolerance) { m_latencyTolerance = tolerance; }
+  double latencyTolerance() const { return m_latencyTolerance; }
+
+  double window() const { return m_window; }
+  int inFlight() const { return m_inFlight; }
+  int queued() const { return static_cast<int>(m_queue.size()); }
+
+  // Call start as soon as the window allows another request in flight.
+  // If context is destroyed before then, start is dropped. Every call of
+  // start must be followed by exactly one call to release().
+  void acquire(QObject* context, std::function<void()> start);
+
+  // Report that a started request finished. A negative latency means the
+  // request was cancelled, and it does not affect the window.
+  void release(qint64 latencyMsecs, bool congested);
+
+signals:
+  // Emitted whenever the window or the number of requests changes
+  void windowChanged(double window, int inFlight, int queued);
+
+private:
+  void startQueued();
+
+  double m_window = 4.0;
+  double m_minWindow = 1.0;
+  double m_maxWindow = 32.0;
+  double m_latencyTolerance = 4.0;
+
+  int m_inFlight = 0;
+
+  // Exponentially weighted moving average of the latency in msecs
+  double m_smoothedLatency = -1.0;
+
+  // Time since the window was last decreased
+  QElapsedTimer m_sinceDecrease;
+
+  std::deque<QPair<QPointer<QObject>, std::function<void()> > > m_queue;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,249 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdercrawler.h"
+
+#include "girderconcurrencylimiter.h"
+#include "girderrequest.h"
+
+#include <QDebug>
+
+namespace cumulus
+{
+
+// How often the index is saved during a crawl, in msecs. Saving appends
+// the objects found since, and what is left to list.
+static const qint64 checkpointInterval = 60 * 1000;
+
+GirderCrawler::GirderCrawler(QNetworkAccessManager* networkManager, QObject* parent)
+  : QObject(parent)
+  , m_networkManager(networkManager)
+{
+}
+
+GirderCrawler::~GirderCrawler()
+{
+  stop();
+}
+
+void GirderCrawler::setApiUrl(const QString& url)
+{
+  if (url == m_apiUrl)
+    return;
+
+  stop();
+  m_apiUrl = url;
+  m_index.setApiUrl(url);
+}
+
+template<typename Request>
+Request* GirderCrawler::addRequest(Request* request)
+{
+  request->setParent(this);
+  request->setConcurrencyLimiter(GirderConcurrencyLimiter::bulkLimiter());
+  request->setTrafficClass(GirderRateLimiter::TrafficClass::metadata);
+  connect(request, &Request::unauthorized, this, [this]() {
+    stop();
+    emit error("The girder token was rejected.");
+  });
+  m_requests.append(request);
+  return request;
+}
+
+void GirderCrawler::crawl(const QMap<QString, QString>& root)
+{
+  stop();
+
+  m_root = root;
+  m_queue = { root };
+  m_crawled = 0;
+  m_crawling = true;
+  m_sinceCheckpoint.start();
+
+  // Paths of the results start from the top, not from the root
+  if (root.value("type") == "folder" || root.value("type") == "item")
+  {
+    GetRootPathRequest* rootPathRequest = addRequest(new GetRootPathRequest(
+      m_networkManager, m_apiUrl, m_girderToken, root.value("id"), root.value("type")));
+    int generation = m_generation;
+    sendAsync(rootPathRequest, &GetRootPathRequest::rootPath)
+      .subscribe(
+        [this, generation, root, rootPathRequest](const QList<QMap<QString, QString> >& rootPath) {
+          if (generation == m_generation)
+            m_index.addRootPath(rootPath, root);
+          rootPathRequest->deleteLater();
+        },
+        [rootPathRequest](const QString& message) {
+          qDebug() << "Failed to get the root path of the crawl:" << message;
+          rootPathRequest->deleteLater();
+        });
+  }
+  else
+  {
+    m_index.addRootPath(QList<QMap<QString, QString> >(), root);
+  }
+
+  listNext();
+}
+
+void GirderCrawler::resume()
+{
+  if (m_crawling || !m_index.hasCheckpoint())
+    return;
+
+  const GirderTreeIndex::Checkpoint& checkpoint = m_index.checkpoint();
+  m_root = checkpoint.root;
+  m_queue = checkpoint.pending;
+  m_crawled = checkpoint.crawled;
+  m_crawling = true;
+  m_sinceCheckpoint.start();
+
+  listNext();
+}
+
+void GirderCrawler::stop()
+{
+  if (!m_crawling)
+    return;
+
+  // What was being listed has to be listed again after a resume
+  m_queue = m_listing + m_queue;
+  m_listing.clear();
+  saveCheckpoint();
+
+  ++m_generation;
+  for (GirderRequest* request : m_requests)
+  {
+    if (request)
+    {
+      request->disconnect();
+      request->deleteLater();
+    }
+  }
+  m_requests.clear();
+  m_queue.clear();
+  m_crawling = false;
+}
+
+void GirderCrawler::saveCheckpoint()
+{
+  GirderTreeIndex::Checkpoint checkpoint;
+  checkpoint.root = m_root;
+  checkpoint.pending = m_listing + m_queue;
+  checkpoint.crawled = m_crawled;
+  m_index.setCheckpoint(checkpoint);
+  m_index.save();
+  m_sinceCheckpoint.start();
+}
+
+void GirderCrawler::listNext()
+{
+  while (m_crawling && !m_queue.isEmpty() && m_listing.size() < m_maxConcurrentListings)
+  {
+    QMap<QString, QString> parentInfo = m_queue.takeFirst();
+    m_listing.append(parentInfo);
+    list(parentInfo);
+  }
+
+  if (m_crawling && m_queue.isEmpty() && m_listing.isEmpty())
+  {
+    m_crawling = false;
+    m_index.clearCheckpoint();
+    m_index.save();
+    emit finished();
+  }
+}
+
+void GirderCrawler::list(const QMap<QString, QString>& parentInfo)
+{
+  QString type = parentInfo.value("type");
+  QString id = parentInfo.value("id");
+
+  // Each part adds its children to the index, and queues those that have
+  // contents of their own
+  QList<GirderFuture<bool> > parts;
+  QList<GirderRequest*> requests;
+  auto addChildren = [this, parentInfo](const QString& childType, bool queue) {
+    return [this, parentInfo, childType, queue](const QList<QMap<QString, QString> >& children) {
+      m_index.addChildren(parentInfo, childType, children);
+      if (!queue)
+        return;
+
+      for (const auto& child : children)
+      {
+        QMap<QString, QString> childInfo;
+        childInfo["type"] = childType;
+        childInfo["id"] = child.value("id");
+        m_queue.append(childInfo);
+      }
+    };
+  };
+
+  if (type == "folder" || type == "user" || type == "collection")
+  {
+    auto* request =
+      addRequest(new ListFoldersRequest(m_networkManager, m_apiUrl, m_girderToken, id, type));
+    requests.append(request);
+    parts.append(sendAsync(request, &ListFoldersRequest::details).then(addChildren("folder", true)));
+  }
+
+  if (type == "folder")
+  {
+    auto* request = addRequest(new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, id));
+    requests.append(request);
+    parts.append(sendAsync(request, &ListItemsRequest::details).then(addChildren("item", true)));
+  }
+
+  if (type == "item")
+  {
+    auto* request = addRequest(new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, id));
+    requests.append(request);
+    parts.append(sendAsync(request, &ListFilesRequest::details).then(addChildren("file", false)));
+  }
+
+  int generation = m_generation;
+  whenAll(parts).subscribe(
+    [this, generation, parentInfo, requests](const QList<bool>&) {
+      if (generation != m_generation)
+        return;
+
+      for (GirderRequest* request : requests)
+        request->deleteLater();
+      finishListing(parentInfo);
+    },
+    [this, generation, parentInfo, requests](const QString& message) {
+      if (generation != m_generation)
+        return;
+
+      // One object that cannot be listed does not stop the crawl
+      qDebug() << "Failed to crawl" << parentInfo.value("type") << parentInfo.value("id")
+               << ":" << message;
+      for (GirderRequest* request : requests)
+        request->deleteLater();
+      finishListing(parentInfo);
+    });
+}
+
+void GirderCrawler::finishListing(const QMap<QString, QString>& parentInfo)
+{
+  m_listing.removeOne(parentInfo);
+  ++m_crawled;
+
+  // Forget the requests that are done
+  m_requests.removeAll(QPointer<GirderRequest>());
+
+  if (m_sinceCheckpoint.elapsed() > checkpointInterval)
+    saveCheckpoint();
+
+  emit progress(m_crawled, m_queue.size() + m_listing.size());
+  listNext();
+}
+
+} // end namespace
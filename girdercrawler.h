@@ -0,0 +1,118 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdercrawler.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdercrawler_h
+#define girderfilebrowser_girdercrawler_h
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+
+#include "girdertreeindex.h"
+
+class QNetworkAccessManager;
+
+namespace cumulus
+{
+
+class GirderRequest;
+
+// Walks a subtree in the background, breadth first, and records every
+// folder, item and file in a GirderTreeIndex. Only a few objects are
+// listed at a time, as bulk traffic. The state of the crawl is saved with
+// the index every so often, so that an interrupted crawl can be resumed.
+class GirderCrawler : public QObject
+{
+  Q_OBJECT
+
+public:
+  explicit GirderCrawler(QNetworkAccessManager* networkManager, QObject* parent = nullptr);
+  ~GirderCrawler() override;
+
+  // Stops the current crawl, and loads the index of url
+  void setApiUrl(const QString& url);
+  void setGirderToken(const QString& token) { m_girderToken = token; }
+
+  // At most this many objects are listed at a time
+  void setMaxConcurrentListings(int count) { m_maxConcurrentListings = count; }
+  int maxConcurrentListings() const { return m_maxConcurrentListings; }
+
+  bool isCrawling() const { return m_crawling; }
+
+  // Whether a crawl of this server was interrupted
+  bool canResume() const { return m_index.hasCheckpoint(); }
+
+  const GirderTreeIndex& index() const { return m_index; }
+
+public slots:
+  // Crawl everything below root, which should contain "name", "id", and
+  // "type". Starts over if another crawl was interrupted.
+  void crawl(const QMap<QString, QString>& root);
+
+  // Continue the interrupted crawl, if any
+  void resume();
+
+  // Stop crawling. The crawl can be resumed later.
+  void stop();
+
+signals:
+  // Emitted after every listing. pending is the number of objects left to
+  // list, which grows as the crawl goes deeper.
+  void progress(int crawled, int pending);
+
+  // Emitted once everything below the root is in the index
+  void finished();
+
+  // Emitted when the crawl stops because of an error
+  void error(const QString& message);
+
+private:
+  // Start as many listings as the limit allows
+  void listNext();
+  void list(const QMap<QString, QString>& parentInfo);
+  void finishListing(const QMap<QString, QString>& parentInfo);
+
+  // Save the index with what is left to list
+  void saveCheckpoint();
+
+  // Take ownership of a request until it is done
+  template<typename Request>
+  Request* addRequest(Request* request);
+
+  QNetworkAccessManager* m_networkManager;
+  QString m_apiUrl;
+  QString m_girderToken;
+
+  GirderTreeIndex m_index;
+
+  bool m_crawling = false;
+  int m_maxConcurrentListings = 4;
+  QMap<QString, QString> m_root;
+  // Objects to list, in breadth first order, and those being listed
+  QList<QMap<QString, QString> > m_queue;
+  QList<QMap<QString, QString> > m_listing;
+  int m_crawled = 0;
+
+  QList<QPointer<GirderRequest> > m_requests;
+  // Bumped by stop() to drop the listings that are still coming in
+  int m_generation = 0;
+
+  QElapsedTimer m_sinceCheckpoint;
+};
+
+} // end namespace
+
+#endif
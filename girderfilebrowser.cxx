@@ -14,10 +14,14 @@
 
 #include <QApplication>
 #include <QDebug>
+#include <QElapsedTimer>
 #include <QNetworkAccessManager>
 #include <QString>
 
 #include "girderauthenticator.h"
+#include "girdernetworkmanagerpool.h"
+#include "girderrequest.h"
+#include "girdersessioncache.h"
 #include "ui/girderfilebrowserdialog.h"
 #include "ui/girderlogindialog.h"
 
@@ -25,6 +29,11 @@ int main(int argc, char* argv[])
 {
   QApplication app(argc, argv);
 
+  // Set GIRDER_STARTUP_TRACE to print how long each startup step took
+  QElapsedTimer launchTimer;
+  launchTimer.start();
+  bool traceStartup = !qgetenv("GIRDER_STARTUP_TRACE").isEmpty();
+
   std::unique_ptr<QNetworkAccessManager> networkManager(new QNetworkAccessManager);
 
   using cumulus::GirderLoginDialog;
@@ -33,6 +42,12 @@ int main(int argc, char* argv[])
   using cumulus::GirderAuthenticator;
   GirderAuthenticator girderAuthenticator(networkManager.get());
 
+  // Remember the token between launches, so that we can start browsing
+  // without authenticating again
+  using cumulus::GirderSessionCache;
+  GirderSessionCache sessionCache;
+  girderAuthenticator.setSessionCache(&sessionCache);
+
   // Below is an example of creating a custom root folder.
   // It needs to match the girder information exactly, or the behavior is
   // undefined
@@ -41,6 +56,15 @@ int main(int argc, char* argv[])
 //  customRootFolder["id"] = "5b16b1fd8d777f15ebe1ffc9";
 //  customRootFolder["type"] = "folder";
 
+  // An example of spreading requests over several network managers, to
+  // get past the limit of six connections per host of each manager.
+  //cumulus::GirderNetworkManagerPool networkManagerPool(4, networkManager.get());
+  //cumulus::GirderRequest::setNetworkManagerPool(&networkManagerPool);
+
+  // An example of allowing requests to be multiplexed over HTTP/2.
+  //cumulus::GirderRequest::setTransportProfile(
+  //  cumulus::GirderRequest::TransportProfile::http2);
+
   using cumulus::GirderFileBrowserDialog;
   GirderFileBrowserDialog gfbDialog(networkManager.get());
 
@@ -50,28 +74,38 @@ int main(int argc, char* argv[])
   QString apiUrl = std::getenv("GIRDER_API_URL");
   QString apiKey = std::getenv("GIRDER_API_KEY");
 
+  // Without an api url, try the server of the last session
+  if (apiUrl.isEmpty())
+    apiUrl = sessionCache.lastApiUrl();
+
   if (!apiUrl.isEmpty())
     loginDialog.setApiUrl(apiUrl);
 
   // Attempt api key authentication if both environment variables are present
   std::unique_ptr<QMetaObject::Connection> tempCon;
-  if (!apiUrl.isEmpty() && !apiKey.isEmpty())
-  {
-    tempCon.reset(new QMetaObject::Connection());
-    girderAuthenticator.authenticateApiKey(apiUrl, apiKey);
-    // If authentication fails, show the dialog, but only once.
-    *tempCon = QObject::connect(&girderAuthenticator,
-      &GirderAuthenticator::authenticationErrored,
-      &loginDialog,
-      [&loginDialog, &tempCon]() {
-        loginDialog.show();
-        tempCon.reset();
-      });
-  }
-  else
-  {
-    loginDialog.show();
-  }
+  auto authenticate = [&]() {
+    if (!apiUrl.isEmpty() && !apiKey.isEmpty())
+    {
+      tempCon.reset(new QMetaObject::Connection());
+      girderAuthenticator.authenticateApiKey(apiUrl, apiKey);
+      // If authentication fails, show the dialog, but only once.
+      *tempCon = QObject::connect(&girderAuthenticator,
+        &GirderAuthenticator::authenticationErrored,
+        &loginDialog,
+        [&loginDialog, &tempCon]() {
+          loginDialog.show();
+          tempCon.reset();
+        });
+    }
+    else
+    {
+      loginDialog.show();
+    }
+  };
+
+  // A token from a previous launch skips authentication entirely
+  if (apiUrl.isEmpty() || !girderAuthenticator.authenticateCachedSession(apiUrl))
+    authenticate();
 
   // Connect the "ok" button of the login dialog to the girder authenticator
   QObject::connect(&loginDialog,
@@ -83,6 +117,14 @@ int main(int argc, char* argv[])
     &GirderAuthenticator::authenticationErrored,
     &loginDialog,
     &GirderLoginDialog::authenticationFailed);
+  // Report whether requests can be multiplexed over HTTP/2
+  QObject::connect(&girderAuthenticator,
+    &GirderAuthenticator::transportNegotiated,
+    [](bool multiplexed) {
+      if (cumulus::GirderRequest::transportProfile() ==
+          cumulus::GirderRequest::TransportProfile::http2)
+        qDebug() << "HTTP/2 multiplexing negotiated:" << multiplexed;
+    });
   // If authentication fails, also print it to the terminal
   QObject::connect(&girderAuthenticator,
     &GirderAuthenticator::authenticationErrored,
@@ -107,6 +149,38 @@ int main(int argc, char* argv[])
     &gfbDialog,
     &GirderFileBrowserDialog::show);
 
+  // If the server rejects the token (it may have been revoked), forget it
+  // and authenticate again.
+  QObject::connect(&gfbDialog,
+    &GirderFileBrowserDialog::authenticationRequired,
+    [&girderAuthenticator, &authenticate]() {
+      girderAuthenticator.forgetCachedSession();
+      authenticate();
+    });
+
+  if (traceStartup)
+  {
+    QObject::connect(&girderAuthenticator,
+      &GirderAuthenticator::authenticationSucceeded,
+      [&launchTimer]() { qDebug() << "startup:" << launchTimer.elapsed() << "ms authenticated"; });
+    QObject::connect(&gfbDialog,
+      &GirderFileBrowserDialog::startupTrace,
+      [&launchTimer](const QString& event, qint64) {
+        qDebug() << "startup:" << launchTimer.elapsed() << "ms" << event;
+      });
+  }
+
+  // Set GIRDER_PREFETCH_STATS to print how many prefetched listings were used
+  if (!qgetenv("GIRDER_PREFETCH_STATS").isEmpty())
+  {
+    QObject::connect(&gfbDialog,
+      &GirderFileBrowserDialog::prefetchStatistics,
+      [](int issued, int hits, qint64 usedBytes, qint64 wastedBytes) {
+        qDebug() << "prefetch:" << hits << "of" << issued << "used," << usedBytes
+                 << "bytes used," << wastedBytes << "bytes wasted";
+      });
+  }
+
   // Just a simple demonstration of how an object can be chosen
   QObject::connect(&gfbDialog,
     &GirderFileBrowserDialog::objectChosen,
@@ -10,22 +10,22 @@
 
 #include "girderfilebrowserfetcher.h"
 
+#include "girderconcurrencylimiter.h"
 #include "girderrequest.h"
 
+#include <QDateTime>
+#include <QDebug>
 #include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTimer>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
 
 namespace cumulus
 {
 
-// Set the various names we will use for the requests
-static const QString& GET_FOLDERS_REQUEST = "getFoldersRequest";
-static const QString& GET_ITEMS_REQUEST = "getItemsRequest";
-static const QString& GET_FILES_REQUEST = "getFilesRequest";
-static const QString& GET_ROOT_PATH_REQUEST = "getRootPathRequest";
-static const QString& GET_USERS_REQUEST = "getUsersRequest";
-static const QString& GET_COLLECTIONS_REQUEST = "getCollectionsRequest";
-static const QString& GET_MY_USER_REQUEST = "getMyUserRequest";
-
 // The folder info for the special cases
 static const QMap<QString, QString> ROOT_FOLDER_INFO = { { "name", "root" },
   { "id", "" },
@@ -39,28 +39,94 @@ static const QMap<QString, QString> COLLECTIONS_FOLDER_INFO = { { "name", "Colle
   { "id", "" },
   { "type", "Collections" } };
 
+// Rows are kept for this many listings
+static const int maxRowListings = 16;
+
+static bool nameLessThan(const QMap<QString, QString>& a, const QMap<QString, QString>& b)
+{
+  return a.value("name") < b.value("name");
+}
+
+// Only folder and item listings have a high-water mark
+static QString highWaterMark(GirderRequest*)
+{
+  return QString();
+}
+
+static QString highWaterMark(ListFoldersRequest* request)
+{
+  return request->highWaterMark();
+}
+
+static QString highWaterMark(ListItemsRequest* request)
+{
+  return request->highWaterMark();
+}
+
+GirderListing GirderFileBrowserFetcher::cachedListing(const QMap<QString, QString>& myUserInfo)
+{
+  GirderListing listing;
+  listing.append(myUserInfo.value("id"), myUserInfo.value("login"));
+  listing.finish();
+  return listing;
+}
+
 GirderFileBrowserFetcher::GirderFileBrowserFetcher(QNetworkAccessManager* networkManager,
   QObject* parent)
   : QObject(parent)
   , m_networkManager(networkManager)
+  , m_changePollTimer(new QTimer)
 {
-  // These indicate if a folder request is currently pending
-  m_folderRequestPending["folders"] = false;
-  m_folderRequestPending["items"] = false;
-  m_folderRequestPending["files"] = false;
-  m_folderRequestPending["rootPath"] = false;
+  connect(m_changePollTimer.get(), &QTimer::timeout, this, [this]() { pollForChanges(); });
 
   // Any time a request is completed, delete the previous cache
   connect(this, &GirderFileBrowserFetcher::folderInformation,
           [this](){ clearAllCachedPreviousInfo(); });
 
+  // The startup is over once the first listing is ready
+  connect(this, &GirderFileBrowserFetcher::folderInformation, [this]() {
+    traceStartup("first listing ready");
+    m_startupClock.invalidate();
+  });
+
+  connect(this, &GirderFileBrowserFetcher::folderInformation, [this]() { predictNextFolders(); });
+
+  // Share the new listings with other processes
+  connect(this, &GirderFileBrowserFetcher::folderInformation, [this]() { m_listingStore.save(); });
+
+  connect(this,
+    &GirderFileBrowserFetcher::folderInformation,
+    [this](const QMap<QString, QString>&,
+      const QList<QMap<QString, QString> >&,
+      const QList<QMap<QString, QString> >&,
+      const QList<QMap<QString, QString> >& rootPath) { warmAncestorListings(rootPath); });
+
   // This is done to set all the cache bools to false
   clearAllCachedPreviousInfo();
 }
 
-GirderFileBrowserFetcher::~GirderFileBrowserFetcher() = default;
+GirderFileBrowserFetcher::~GirderFileBrowserFetcher()
+{
+  qDeleteAll(m_girderRequests);
+  // The prefetch requests must go before the listing cache does
+  qDeleteAll(findChildren<GirderRequest*>(QString(), Qt::FindDirectChildrenOnly));
+}
+
+// Returns a future with the same outcome as future, but with
+// prefix prepended to its error message
+template<typename T>
+static GirderFuture<T> withErrorPrefix(const GirderFuture<T>& future, const QString& prefix)
+{
+  return future.mapError([prefix](const QString& message) { return prefix + message; });
+}
 
 void GirderFileBrowserFetcher::getFolderInformation(const QMap<QString, QString>& parentInfo)
+{
+  openFolder(parentInfo, nullptr);
+}
+
+void GirderFileBrowserFetcher::openFolder(const QMap<QString, QString>& parentInfo,
+  const QList<QMap<QString, QString> >* knownRootPath)
 {
   // Clear all requests to cancel any existing requests, and restore the
   // previous state if this is an interruption.
@@ -73,6 +139,7 @@ void GirderFileBrowserFetcher::getFolderInformation(const QMap<QString, QString>
   // Save this info to process the current request
   m_previousParentInfo = m_currentParentInfo;
   m_currentParentInfo = parentInfo;
+  m_offlineListingAge = -1;
 
   // The first two directory levels will be different from the rest.
   if (currentParentType() == "root")
@@ -91,21 +158,185 @@ void GirderFileBrowserFetcher::getFolderInformation(const QMap<QString, QString>
     return;
   }
 
-  // For the standard case
-  getContainingFolders();
-  getContainingItems();
-  getContainingFiles();
-  getRootPath();
+  // Files come from the listing of an item parent, or from file bumping.
+  // Either may be cached and finish right away, so clear them first.
+  m_currentFiles.clear();
+
+  // For the standard case, all parts are fetched in parallel
+  QList<GirderFuture<bool> > parts;
+  parts.append(getContainingFolders());
+  parts.append(getContainingItems());
+  parts.append(getContainingFiles());
+  parts.append(getRootPath(knownRootPath));
+
+  // Whatever was prefetched for this folder was taken above. The user
+  // moved on from the rest.
+  cancelPrefetches(m_speculativeRequests);
+  cancelPrefetches(m_predictedRequests);
+
+  whenAll(parts).subscribe(
+    [this](const QList<bool>&) { finishGettingFolderInformation(); },
+    [this](const QString& message) { errorReceived(message); });
+}
+
+void GirderFileBrowserFetcher::revalidateFolderInformation(
+  const QMap<QString, QString>& parentInfo,
+  const QList<QMap<QString, QString> >& rootPath)
+{
+  // The folder may have moved since rootPath was saved. Online, the root
+  // path is worked out as usual, from the ancestor index or the server.
+  openFolder(parentInfo, shouldRequest() ? nullptr : &rootPath);
+}
+
+bool GirderFileBrowserFetcher::storedFolderInformation(const QMap<QString, QString>& parentInfo,
+  QList<QMap<QString, QString> >& folders,
+  QList<QMap<QString, QString> >& files)
+{
+  QString type = parentInfo.value("type");
+  QString id = parentInfo.value("id");
+  QString highWaterMark;
+  GirderListingCache::Listing storedFolders;
+  GirderListingCache::Listing storedItems;
+  GirderListingCache::Listing storedFiles;
+
+  bool found = false;
+  if (type == "user" || type == "collection" || type == "folder")
+    found |= m_listingStore.findForRefresh(
+      GirderListingCache::foldersKey(type, id), storedFolders, highWaterMark);
+  if (type == "folder")
+    found |= m_listingStore.findForRefresh(
+      GirderListingCache::itemsKey(id), storedItems, highWaterMark);
+  if (type == "item")
+    found |= m_listingStore.findForRefresh(
+      GirderListingCache::filesKey(id), storedFiles, highWaterMark);
+  if (!found)
+    return false;
+
+  // Items whose contents were not stored are not bumped
+  if (m_itemMode == ItemMode::treatItemsAsFoldersWithFileBumping && !storedItems.isEmpty())
+  {
+    GirderListingCache::Listing unbumped;
+    for (int row = 0; row < storedItems.size(); ++row)
+    {
+      GirderListingCache::Listing itemFiles;
+      if (m_listingStore.findForRefresh(
+            GirderListingCache::filesKey(storedItems.key(row)), itemFiles, highWaterMark) &&
+        itemFiles.size() == 1 && itemFiles.value(0) == storedItems.value(row))
+        storedFiles.append(itemFiles.keyBytes(0), itemFiles.valueBytes(0));
+      else
+        unbumped.append(storedItems.keyBytes(row), storedItems.valueBytes(row));
+    }
+    unbumped.finish();
+    storedFiles.finish();
+    storedItems = unbumped;
+  }
+
+  listingRows(parentInfo, storedFolders, storedItems, storedFiles, folders, files);
+  return true;
+}
+
+void GirderFileBrowserFetcher::getFolderInformationFromPath(const QString& path)
+{
+  QStringList segments = path.split('/', QString::SkipEmptyParts);
+
+  // The top two levels are not girder objects
+  if (segments.isEmpty())
+  {
+    getFolderInformation(m_customRootInfo.isEmpty() ? ROOT_FOLDER_INFO : m_customRootInfo);
+    return;
+  }
+  else if (segments.size() == 1 && segments[0] == "user")
+  {
+    getFolderInformation(USERS_FOLDER_INFO);
+    return;
+  }
+  else if (segments.size() == 1 && segments[0] == "collection")
+  {
+    getFolderInformation(COLLECTIONS_FOLDER_INFO);
+    return;
+  }
+
+  clearAllRequestsAndRestorePreviousState();
+
+  QString normalizedPath = "/" + segments.join('/');
+  LookupPathRequest* lookupPathRequest = addRequest(
+    new LookupPathRequest(m_networkManager, m_apiUrl, m_girderToken, normalizedPath));
+
+  withErrorPrefix(sendAsync(lookupPathRequest, &LookupPathRequest::object),
+    QString("Failed to find %1:\n").arg(normalizedPath))
+    .subscribe(
+      [this, segments](const QMap<QString, QString>& objectInfo) {
+        finishLookingUpPath(segments, objectInfo);
+      },
+      [this](const QString& message) { errorReceived(message); });
+}
+
+void GirderFileBrowserFetcher::finishLookingUpPath(const QStringList& segments,
+  const QMap<QString, QString>& objectInfo)
+{
+  QStringList folderTypes{ "user", "collection", "folder" };
+  if (treatItemsAsFolders())
+    folderTypes.append("item");
+
+  if (!folderTypes.contains(objectInfo.value("type")))
+  {
+    errorReceived(QString("/%1 is a %2, not a folder.")
+                    .arg(segments.join('/'))
+                    .arg(objectInfo.value("type")));
+    return;
+  }
+
+  // A custom root has to be found in the root path, so work it out the
+  // usual way
+  if (!m_customRootInfo.isEmpty())
+  {
+    getFolderInformation(objectInfo);
+    return;
+  }
+
+  QList<QMap<QString, QString> > rootPath{ ROOT_FOLDER_INFO,
+    segments[0] == "user" ? USERS_FOLDER_INFO : COLLECTIONS_FOLDER_INFO };
+
+  QList<QMap<QString, QString> > knownPath;
+  QMap<QString, QString> missing;
+  if (m_ancestorIndex.rootPath(objectInfo, knownPath, missing))
+  {
+    rootPath += knownPath;
+  }
+  else
+  {
+    // Every segment between the top and the object is an ancestor
+    QString ancestorPath = "/" + segments[0];
+    for (int i = 1; i < segments.size() - 1; ++i)
+    {
+      ancestorPath += "/" + segments[i];
+
+      QMap<QString, QString> ancestor;
+      ancestor["type"] = i == 1 ? segments[0] : QString("folder");
+      ancestor["id"] = "";
+      ancestor["name"] = segments[i];
+      ancestor["path"] = ancestorPath;
+      rootPath.append(ancestor);
+    }
+  }
+
+  // The root path was just looked up, so it is used as it is
+  openFolder(objectInfo, &rootPath);
 }
 
 void GirderFileBrowserFetcher::clearAllRequests()
 {
+  // A request may be in the middle of emitting a signal, so disconnect
+  // it (which also drops its pending futures) and let Qt delete it once
+  // control returns to the event loop.
+  for (GirderRequest* request : m_girderRequests)
+  {
+    request->disconnect();
+    request->deleteLater();
+  }
   m_girderRequests.clear();
-  m_itemContentsRequests.clear();
-
-  // Indicate that no requests are pending
-  for (const auto& key: m_folderRequestPending.keys())
-    m_folderRequestPending[key] = false;
+  ++m_requestGeneration;
+  clearPollRequests();
 }
 
 // Clear all requests and restore any previous cached info if an error
@@ -151,50 +382,68 @@ void GirderFileBrowserFetcher::restoreAllCachedPreviousInfo()
   clearAllCachedPreviousInfo();
 }
 
-// A convenience function to do three things:
-//   1. Call "send()" on the GirderRequest sender.
-//   2. Create connections for finish condition.
-//   3. Create connections for error condition.
-// Sender must be a GirderRequest object, and Receiver must be
-// a GirderFileBrowserFetcher object. Slot can be either a
-// GirderFileBrowserFetcher function or a lambda.
-template<typename Sender, typename Signal, typename Receiver, typename Slot>
-static void sendAndConnect(Sender* sender, Signal signal, Receiver* receiver, Slot slot)
-{
-  sender->send();
-
-  QObject::connect(sender, signal, receiver, slot);
-  QObject::connect(
-    sender, &GirderRequest::error, receiver, &GirderFileBrowserFetcher::errorReceived);
-}
-
 void GirderFileBrowserFetcher::getHomeFolderInformation()
 {
   // Clear all requests to cancel any existing requests, and restore the
   // previous state if this is an interruption.
   clearAllRequestsAndRestorePreviousState();
 
-  std::unique_ptr<GetMyUserRequest> getMyUserRequest(
-    new GetMyUserRequest(m_networkManager, m_apiUrl, m_girderToken));
-
-  sendAndConnect(getMyUserRequest.get(),
-    &GetMyUserRequest::myUser,
-    this,
-    [this](const QMap<QString, QString>& myUserInfo) {
-      QMap<QString, QString> myUserMap;
-      myUserMap["name"] = myUserInfo.value("login");
-      myUserMap["id"] = myUserInfo.value("id");
-      myUserMap["type"] = "user";
-      getFolderInformation(myUserMap);
-    });
+  // The user is kept as a listing of <id => login>
+  auto storedUser = [](const GirderListingCache::Listing& listing) {
+    QMap<QString, QString> myUserInfo;
+    myUserInfo["id"] = listing.key(0);
+    myUserInfo["login"] = listing.value(0);
+    return myUserInfo;
+  };
 
-  m_girderRequests[GET_MY_USER_REQUEST] = std::move(getMyUserRequest);
-}
+  GirderFuture<QMap<QString, QString> > myUser;
+  GirderFuture<GirderListingCache::Listing> knownUser =
+    takePrefetched(GirderListingCache::myUserKey());
+  if (!knownUser.isValid() && !shouldRequest())
+    knownUser = storedListing(GirderListingCache::myUserKey());
+  if (knownUser.isValid())
+  {
+    myUser = knownUser.then(storedUser);
+  }
+  else
+  {
+    GetMyUserRequest* getMyUserRequest =
+      addRequest(new GetMyUserRequest(m_networkManager, m_apiUrl, m_girderToken));
+    myUser = sendAsync(getMyUserRequest, &GetMyUserRequest::myUser);
+
+    GirderPromise<QMap<QString, QString> > promise;
+    myUser.subscribe(
+      [this, promise](const QMap<QString, QString>& myUserInfo) {
+        setUnreachable(false);
+        m_listingStore.insert(GirderListingCache::myUserKey(), cachedListing(myUserInfo));
+        promise.resolve(myUserInfo);
+      },
+      [this, promise, storedUser](const QString& message) {
+        if (!isOffline())
+        {
+          promise.reject(message);
+          return;
+        }
+        storedListing(GirderListingCache::myUserKey())
+          .then(storedUser)
+          .subscribe(
+            [promise](const QMap<QString, QString>& myUserInfo) { promise.resolve(myUserInfo); },
+            [promise, message](const QString&) { promise.reject(message); });
+      });
+    myUser = promise.future();
+  }
 
-bool GirderFileBrowserFetcher::folderRequestPending() const
-{
-  const QList<bool>& list = m_folderRequestPending.values();
-  return std::any_of(list.cbegin(), list.cend(), [](bool b) { return b; });
+  withErrorPrefix(myUser,
+    "Failed to get information about current user:\n")
+    .subscribe(
+      [this](const QMap<QString, QString>& myUserInfo) {
+        QMap<QString, QString> myUserMap;
+        myUserMap["name"] = myUserInfo.value("login");
+        myUserMap["id"] = myUserInfo.value("id");
+        myUserMap["type"] = "user";
+        getFolderInformation(myUserMap);
+      },
+      [this](const QString& message) { errorReceived(message); });
 }
 
 void GirderFileBrowserFetcher::getRootFolderInformation()
@@ -214,54 +463,58 @@ void GirderFileBrowserFetcher::getRootFolderInformation()
 
 void GirderFileBrowserFetcher::getUsersFolderInformation()
 {
-  std::unique_ptr<GetUsersRequest> getUsersRequest(
-    new GetUsersRequest(m_networkManager, m_apiUrl, m_girderToken));
-
-  sendAndConnect(getUsersRequest.get(),
-    &GetUsersRequest::users,
-    this,
-    [this](const QMap<QString, QString>& usersMap) {
-      finishGettingSecondLevelFolderInformation("user", usersMap);
-    });
+  QString key = GirderListingCache::usersKey();
+  GirderFuture<GirderListingCache::Listing> users = takePrefetched(key);
+  if (!users.isValid() && !shouldRequest())
+    users = storedListing(key);
+  if (!users.isValid())
+  {
+    GetUsersRequest* getUsersRequest =
+      addRequest(new GetUsersRequest(m_networkManager, m_apiUrl, m_girderToken));
+    users = orStoredListing(key, sendAsync(getUsersRequest, &GetUsersRequest::listing));
+  }
 
-  m_girderRequests[GET_USERS_REQUEST] = std::move(getUsersRequest);
+  withErrorPrefix(users,
+    "An error occurred while getting users:\n")
+    .subscribe(
+      [this](const GirderListingCache::Listing& users) {
+        m_ancestorIndex.addChildren(QMap<QString, QString>(), "user", users);
+        keepListing(GirderListingCache::usersKey(), users);
+        finishGettingSecondLevelFolderInformation("user", users);
+      },
+      [this](const QString& message) { errorReceived(message); });
 }
 
 void GirderFileBrowserFetcher::getCollectionsFolderInformation()
 {
-  std::unique_ptr<GetCollectionsRequest> getCollectionsRequest(
-    new GetCollectionsRequest(m_networkManager, m_apiUrl, m_girderToken));
-
-  sendAndConnect(getCollectionsRequest.get(),
-    &GetCollectionsRequest::collections,
-    this,
-    [this](const QMap<QString, QString>& collectionsMap) {
-      finishGettingSecondLevelFolderInformation("collection", collectionsMap);
-    });
+  QString key = GirderListingCache::collectionsKey();
+  GirderFuture<GirderListingCache::Listing> collections = takePrefetched(key);
+  if (!collections.isValid() && !shouldRequest())
+    collections = storedListing(key);
+  if (!collections.isValid())
+  {
+    GetCollectionsRequest* getCollectionsRequest =
+      addRequest(new GetCollectionsRequest(m_networkManager, m_apiUrl, m_girderToken));
+    collections = orStoredListing(
+      key, sendAsync(getCollectionsRequest, &GetCollectionsRequest::listing));
+  }
 
-  m_girderRequests[GET_COLLECTIONS_REQUEST] = std::move(getCollectionsRequest);
+  withErrorPrefix(collections,
+    "An error occurred while getting collections:\n")
+    .subscribe(
+      [this](const GirderListingCache::Listing& collections) {
+        m_ancestorIndex.addChildren(QMap<QString, QString>(), "collection", collections);
+        keepListing(GirderListingCache::collectionsKey(), collections);
+        finishGettingSecondLevelFolderInformation("collection", collections);
+      },
+      [this](const QString& message) { errorReceived(message); });
 }
 
 // Type is probably either "user" or "collection"
 void GirderFileBrowserFetcher::finishGettingSecondLevelFolderInformation(const QString& type,
-  const QMap<QString, QString>& map)
+  const GirderListingCache::Listing& listing)
 {
-  int numItems = map.keys().size();
-
-  // Let's sort these by name. QMap sorts by key.
-  QMap<QString, QString> sortedByName;
-  for (const auto& id : map.keys())
-    sortedByName[map.value(id)] = id;
-
-  QList<QMap<QString, QString> > folders;
-  for (const auto& name : sortedByName.keys())
-  {
-    QMap<QString, QString> folderInfo;
-    folderInfo["type"] = type;
-    folderInfo["id"] = sortedByName[name];
-    folderInfo["name"] = name;
-    folders.append(folderInfo);
-  }
+  QList<QMap<QString, QString> > folders = rows(m_currentParentInfo, type, listing);
 
   // We have no files for the second directory level
   QList<QMap<QString, QString> > files;
@@ -274,70 +527,82 @@ void GirderFileBrowserFetcher::finishGettingSecondLevelFolderInformation(const Q
 void GirderFileBrowserFetcher::finishGettingFolderInformation()
 {
   QList<QMap<QString, QString> > folders;
-  for (const auto& id : m_currentFolders.keys())
-  {
-    QString name = m_currentFolders.value(id);
+  QList<QMap<QString, QString> > files;
+  currentRows(folders, files);
+  emit folderInformation(m_currentParentInfo, folders, files, m_currentRootPath);
+}
 
-    QMap<QString, QString> folderInfo;
-    folderInfo["type"] = "folder";
-    folderInfo["id"] = id;
-    folderInfo["name"] = name;
-    folders.append(folderInfo);
-  }
+void GirderFileBrowserFetcher::currentRows(QList<QMap<QString, QString> >& folders,
+  QList<QMap<QString, QString> >& files)
+{
+  listingRows(
+    m_currentParentInfo, m_currentFolders, m_currentItems, m_currentFiles, folders, files);
+}
+
+void GirderFileBrowserFetcher::listingRows(const QMap<QString, QString>& parentInfo,
+  const GirderListingCache::Listing& folderListing,
+  const GirderListingCache::Listing& itemListing,
+  const GirderListingCache::Listing& fileListing,
+  QList<QMap<QString, QString> >& folders,
+  QList<QMap<QString, QString> >& files)
+{
+  folders = rows(parentInfo, "folder", folderListing);
+  files.clear();
 
-  QList<QMap<QString, QString> > files;
   // Do we treat items as files?
   if (treatItemsAsFiles())
   {
-    for (const auto& id : m_currentItems.keys())
-    {
-      QString name = m_currentItems.value(id);
-
-      QMap<QString, QString> fileInfo;
-      fileInfo["type"] = "item";
-      fileInfo["id"] = id;
-      fileInfo["name"] = name;
-      files.append(fileInfo);
-    }
+    files = rows(parentInfo, "item", itemListing);
   }
   // Or do we treat items as folders?
   else if (treatItemsAsFolders())
   {
-    for (const auto& id : m_currentItems.keys())
+    // Both are sorted by name already
+    QList<QMap<QString, QString> > items = rows(parentInfo, "item", itemListing);
+    if (!items.isEmpty())
     {
-      QString name = m_currentItems.value(id);
-
-      QMap<QString, QString> folderInfo;
-      folderInfo["type"] = "item";
-      folderInfo["id"] = id;
-      folderInfo["name"] = name;
-      folders.append(folderInfo);
+      QList<QMap<QString, QString> > merged;
+      merged.reserve(folders.size() + items.size());
+      std::merge(folders.cbegin(), folders.cend(), items.cbegin(), items.cend(),
+        std::back_inserter(merged), nameLessThan);
+      folders = merged;
     }
 
-    for (const auto& id : m_currentFiles.keys())
-    {
-      QString name = m_currentFiles.value(id);
-
-      QMap<QString, QString> fileInfo;
-      fileInfo["type"] = "file";
-      fileInfo["id"] = id;
-      fileInfo["name"] = name;
-      files.append(fileInfo);
-    }
+    files = rows(parentInfo, "file", fileListing);
   }
+}
 
-  // Sort the folders and files by name
-  auto sortFunc = [](const QMap<QString, QString>& a, const QMap<QString, QString>& b) {
-    return a["name"] < b["name"];
-  };
-
-  std::sort(folders.begin(), folders.end(), sortFunc);
-  std::sort(files.begin(), files.end(), sortFunc);
+QList<QMap<QString, QString> > GirderFileBrowserFetcher::rows(
+  const QMap<QString, QString>& parentInfo,
+  const QString& type,
+  const GirderListingCache::Listing& listing)
+{
+  QString key =
+    QString("%1:%2:%3").arg(type).arg(parentInfo.value("type")).arg(parentInfo.value("id"));
+  auto it = m_rows.constFind(key);
+  if (it != m_rows.cend() && it->listing == listing)
+    return it->rows;
+
+  QList<QMap<QString, QString> > built;
+  built.reserve(listing.size());
+  for (int row = 0; row < listing.size(); ++row)
+  {
+    // Rows are where listings become maps, for the dialog
+    QMap<QString, QString> info;
+    info["type"] = type;
+    info["id"] = listing.key(row);
+    info["name"] = listing.value(row);
+    built.append(info);
+  }
+  std::sort(built.begin(), built.end(), nameLessThan);
 
-  emit folderInformation(m_currentParentInfo, folders, files, m_currentRootPath);
+  if (m_rows.size() >= maxRowListings && it == m_rows.cend())
+    m_rows.clear();
+  m_rows.insert(key, Rows{ listing, built });
+  return built;
 }
 
-void GirderFileBrowserFetcher::getContainingFolders()
+GirderFuture<bool> GirderFileBrowserFetcher::getContainingFolders()
 {
   // Cache some info in case there is an interruption or error
   m_cachedPreviousFolders.first = true;
@@ -350,25 +615,28 @@ void GirderFileBrowserFetcher::getContainingFolders()
   // Parent type must be user, collection, or folder, or there are no folders
   QStringList folderParentTypes{ "collection", "user", "folder" };
   if (!folderParentTypes.contains(currentParentType()))
-    return;
-
-  std::unique_ptr<ListFoldersRequest> getFoldersRequest(new ListFoldersRequest(
-    m_networkManager, m_apiUrl, m_girderToken, currentParentId(), currentParentType()));
-
-  sendAndConnect(getFoldersRequest.get(),
-    &ListFoldersRequest::folders,
-    this,
-    [this](const QMap<QString, QString>& folders) {
+    return GirderFuture<bool>::resolved(true);
+
+  QString key = GirderListingCache::foldersKey(currentParentType(), currentParentId());
+  GirderFuture<GirderListingCache::Listing> folders = takePrefetched(key);
+  if (!folders.isValid() && !shouldRequest())
+    folders = storedListing(key);
+  if (!folders.isValid())
+    folders = refreshStoredListing(key, "folder", m_deltaRefreshMinimumSize);
+  if (!folders.isValid())
+    folders = requestListing(key, "folder");
+  folders = orStoredListing(key, folders);
+
+  return withErrorPrefix(folders,
+    "An error occurred while getting folders:\n")
+    .then([this, key](const GirderListingCache::Listing& folders) {
       m_currentFolders = folders;
-      m_folderRequestPending["folders"] = false;
-      finishGettingFolderInformationIfReady();
+      m_ancestorIndex.addChildren(m_currentParentInfo, "folder", folders);
+      keepListing(key, folders);
     });
-
-  m_girderRequests[GET_FOLDERS_REQUEST] = std::move(getFoldersRequest);
-  m_folderRequestPending["folders"] = true;
 }
 
-void GirderFileBrowserFetcher::getContainingItems()
+GirderFuture<bool> GirderFileBrowserFetcher::getContainingItems()
 {
   // Cache some info in case there is an interruption or error
   m_cachedPreviousItems.first = true;
@@ -380,105 +648,215 @@ void GirderFileBrowserFetcher::getContainingItems()
 
   // Parent type must be folder, or there are no items
   if (currentParentType() != "folder")
-    return;
-
-  std::unique_ptr<ListItemsRequest> getItemsRequest(
-    new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, currentParentId()));
-
-  sendAndConnect(getItemsRequest.get(),
-    &ListItemsRequest::items,
-    this,
-    &GirderFileBrowserFetcher::finishGettingContainingItems);
-
-  m_girderRequests[GET_ITEMS_REQUEST] = std::move(getItemsRequest);
-  m_folderRequestPending["items"] = true;
+    return GirderFuture<bool>::resolved(true);
+
+  QString key = GirderListingCache::itemsKey(currentParentId());
+  GirderFuture<GirderListingCache::Listing> items = takePrefetched(key);
+  if (!items.isValid() && !shouldRequest())
+    items = storedListing(key);
+  if (!items.isValid())
+    items = refreshStoredListing(key, "item", m_deltaRefreshMinimumSize);
+  if (!items.isValid())
+    items = requestListing(key, "item");
+  items = orStoredListing(key, items);
+
+  return withErrorPrefix(items,
+    "An error occurred while getting items:\n")
+    .then([this, key](const GirderListingCache::Listing& items) {
+      m_currentItems = items;
+      m_ancestorIndex.addChildren(m_currentParentInfo, "item", items);
+      // Kept before file bumping changes m_currentItems, so that it can be
+      // projected again under another item mode
+      keepListing(key, items);
+      return getFilesForContainingItems();
+    });
 }
 
-void GirderFileBrowserFetcher::finishGettingContainingItems(const QMap<QString, QString>& items)
+GirderFuture<GirderListingCache::Listing> GirderFileBrowserFetcher::requestListing(
+  const QString& key,
+  const QString& childType,
+  bool polling)
 {
-  m_currentItems = items;
-
-  // If we are to treat items as files or folders without file bumping, we are done
-  if (treatItemsAsFiles() || m_itemMode == ItemMode::treatItemsAsFolders || items.empty())
+  // The high-water mark is read as soon as the listing arrives, while the
+  // request is still there
+  if (childType == "folder")
   {
-    m_folderRequestPending["items"] = false;
-    finishGettingFolderInformationIfReady();
+    ListFoldersRequest* request = addRequest(
+      new ListFoldersRequest(
+        m_networkManager, m_apiUrl, m_girderToken, currentParentId(), currentParentType()),
+      polling);
+    return sendAsync(request, &ListFoldersRequest::listing)
+      .then([this, key, request](const GirderListing& folders) {
+        m_listingStore.insert(key, folders, request->highWaterMark());
+        return folders;
+      });
   }
-  else if (m_itemMode == ItemMode::treatItemsAsFoldersWithFileBumping)
-  {
-    // Check the contents of every item. If it only contains a file,
-    // treat that item as a file.
-    // This results in a lot of api calls. Maybe it should be optimized somehow
-    // in the future.
-    for (const QString& itemId : m_currentItems.keys())
-    {
-      std::unique_ptr<ListFilesRequest> listFilesRequest(
-        new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, itemId));
-
-      sendAndConnect(listFilesRequest.get(),
-        &ListFilesRequest::files,
-        this,
-        [this, itemId](const QMap<QString, QString>& files) {
-          finishGettingFilesForContainingItems(files, itemId);
-        });
 
-      m_itemContentsRequests.push_back(std::move(listFilesRequest));
-    }
-  }
+  ListItemsRequest* request = addRequest(
+    new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, currentParentId()), polling);
+  return sendAsync(request, &ListItemsRequest::listing)
+    .then([this, key, request](const GirderListing& items) {
+      m_listingStore.insert(key, items, request->highWaterMark());
+      return items;
+    });
 }
 
-// Only called if m_itemMode is ItemMode::treatItemsAsFoldersWithFileBumping
-void GirderFileBrowserFetcher::finishGettingFilesForContainingItems(
-  const QMap<QString, QString>& files,
-  const QString& itemId)
+GirderFuture<GirderListingCache::Listing> GirderFileBrowserFetcher::refreshStoredListing(
+  const QString& key,
+  const QString& childType,
+  int minimumSize,
+  bool polling)
 {
-  QObject* sender = QObject::sender();
+  GirderListingCache::Listing stored;
+  QString storedMark;
+  if (minimumSize <= 0 || !m_listingStore.findForRefresh(key, stored, storedMark) ||
+      storedMark.isEmpty() || stored.size() < minimumSize)
+  {
+    return GirderFuture<GirderListingCache::Listing>();
+  }
 
-  // Remove this object from the item contents requests
-  auto it = std::find_if(m_itemContentsRequests.begin(),
-    m_itemContentsRequests.end(),
-    [sender](const std::unique_ptr<GirderRequest>& request) { return sender == request.get(); });
+  traceStartup(QString("refreshing stored %1").arg(key));
 
-  if (it != m_itemContentsRequests.end())
-    m_itemContentsRequests.erase(it);
+  // The count is requested alongside the changes
+  GetDetailsRequest* detailsRequest = addRequest(
+    new GetDetailsRequest(
+      m_networkManager, m_apiUrl, m_girderToken, currentParentId(), currentParentType()),
+    polling);
+  GirderFuture<QMap<QString, int> > counts = sendAsync(detailsRequest, &GetDetailsRequest::counts);
 
-  // If there is only one file that has the same name, remove the item and use the file instead.
-  if (files.keys().size() == 1 && files.values()[0] == m_currentItems[itemId])
+  auto newHighWaterMark = std::make_shared<QString>(storedMark);
+  GirderFuture<GirderListingCache::Listing> changes;
+  if (childType == "folder")
   {
-    m_currentItems.remove(itemId);
-    m_currentFiles[files.keys()[0]] = files.values()[0];
+    ListFoldersRequest* request = addRequest(
+      new ListFoldersRequest(
+        m_networkManager, m_apiUrl, m_girderToken, currentParentId(), currentParentType()),
+      polling);
+    request->setUpdatedSince(storedMark);
+    changes = sendAsync(request, &ListFoldersRequest::listing)
+      .then([request, newHighWaterMark](const GirderListing& folders) {
+        *newHighWaterMark = request->highWaterMark();
+        return folders;
+      });
   }
-
-  // If we have finished the last item, indicate that we are done.
-  if (m_itemContentsRequests.empty())
+  else
   {
-    m_folderRequestPending["items"] = false;
-    finishGettingFolderInformationIfReady();
+    ListItemsRequest* request = addRequest(
+      new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, currentParentId()), polling);
+    request->setUpdatedSince(storedMark);
+    changes = sendAsync(request, &ListItemsRequest::listing)
+      .then([request, newHighWaterMark](const GirderListing& items) {
+        *newHighWaterMark = request->highWaterMark();
+        return items;
+      });
   }
+
+  QString countKey = childType == "folder" ? "nFolders" : "nItems";
+  return changes.then([this, key, childType, polling, stored, counts, countKey,
+                        newHighWaterMark](const GirderListingCache::Listing& changed) {
+    return counts.then([this, key, childType, polling, stored, changed, countKey,
+                         newHighWaterMark](
+                         const QMap<QString, int>& countMap) {
+      // Added and renamed children were updated after the mark. They come
+      // after the stored rows, so they replace those with the same id.
+      GirderListingCache::Listing merged = stored;
+      for (int row = 0; row < changed.size(); ++row)
+        merged.append(changed.keyBytes(row), changed.valueBytes(row));
+      merged.finish();
+
+      if (merged.size() != countMap.value(countKey, -1))
+      {
+        traceStartup(QString("stored %1 is missing removals").arg(key));
+        return requestListing(key, childType, polling);
+      }
+
+      m_listingStore.insert(key, merged, *newHighWaterMark);
+      return GirderFuture<GirderListingCache::Listing>::resolved(merged);
+    });
+  });
 }
 
-void GirderFileBrowserFetcher::getContainingFiles()
+GirderFuture<bool> GirderFileBrowserFetcher::getFilesForContainingItems()
 {
-  m_currentFiles.clear();
+  // If we are to treat items as files or folders without file bumping, we are done
+  if (m_itemMode != ItemMode::treatItemsAsFoldersWithFileBumping)
+    return GirderFuture<bool>::resolved(true);
+
+  // Check the contents of every item. If it only contains a file,
+  // treat that item as a file.
+  // This results in a lot of api calls, so they are treated as a bulk
+  // operation and go through the shared concurrency limiter. The contents
+  // are kept, so only those that are not cached are requested.
+  // The items are removed from m_currentItems as they are bumped, which
+  // may happen right away for the cached ones
+  GirderListingCache::Listing items = m_currentItems;
+  QList<GirderFuture<bool> > itemContents;
+  for (int row = 0; row < items.size(); ++row)
+  {
+    QString itemId = items.key(row);
+    QString key = GirderListingCache::filesKey(itemId);
+    GirderFuture<GirderListingCache::Listing> itemFiles = takePrefetched(key);
+    if (!itemFiles.isValid() && !shouldRequest())
+    {
+      // Offline, items whose contents were not stored are not bumped
+      GirderListingCache::Listing stored;
+      QString highWaterMark;
+      m_listingStore.findForRefresh(key, stored, highWaterMark);
+      itemFiles = GirderFuture<GirderListingCache::Listing>::resolved(stored);
+    }
+    if (!itemFiles.isValid())
+    {
+      ListFilesRequest* listFilesRequest =
+        addRequest(new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, itemId));
+      listFilesRequest->setConcurrencyLimiter(GirderConcurrencyLimiter::bulkLimiter());
+      listFilesRequest->setTrafficClass(GirderRateLimiter::TrafficClass::metadata);
+      itemFiles = orStoredListing(key, sendAsync(listFilesRequest, &ListFilesRequest::listing));
+    }
 
+    itemContents.append(itemFiles
+      .then([this, itemId, key](const GirderListingCache::Listing& files) {
+        keepListing(key, files);
+
+        // If there is only one file that has the same name, remove the item
+        // and use the file instead. The files are sorted once all are in.
+        if (files.size() == 1 && files.value(0) == m_currentItems.value(itemId))
+        {
+          m_currentItems.remove(itemId);
+          m_currentFiles.append(files.keyBytes(0), files.valueBytes(0));
+        }
+      }));
+  }
+
+  return withErrorPrefix(whenAll(itemContents), "Failed to get one of the item's contents:\n")
+    .then([this](const QList<bool>&) {
+      m_currentFiles.finish();
+      return true;
+    });
+}
+
+GirderFuture<bool> GirderFileBrowserFetcher::getContainingFiles()
+{
   // Parent type must be item, or there are no files
   if (currentParentType() != "item")
-    return;
+    return GirderFuture<bool>::resolved(true);
 
-  std::unique_ptr<ListFilesRequest> listFilesRequest(
-    new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, currentParentId()));
+  QString key = GirderListingCache::filesKey(currentParentId());
+  GirderFuture<GirderListingCache::Listing> files = takePrefetched(key);
+  if (!files.isValid() && !shouldRequest())
+    files = storedListing(key);
+  if (!files.isValid())
+  {
+    ListFilesRequest* listFilesRequest = addRequest(
+      new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, currentParentId()));
+    files = orStoredListing(key, sendAsync(listFilesRequest, &ListFilesRequest::listing));
+  }
 
-  sendAndConnect(listFilesRequest.get(),
-    &ListFilesRequest::files,
-    this,
-    [this](const QMap<QString, QString>& files) {
+  return withErrorPrefix(files,
+    "An error occurred while getting files:\n")
+    .then([this, key](const GirderListingCache::Listing& files) {
       m_currentFiles = files;
-      m_folderRequestPending["files"] = false;
-      finishGettingFolderInformationIfReady();
+      keepListing(key, files);
     });
-
-  m_girderRequests[GET_FILES_REQUEST] = std::move(listFilesRequest);
-  m_folderRequestPending["files"] = true;
 }
 
 void GirderFileBrowserFetcher::prependNeededRootPathItems()
@@ -525,21 +903,28 @@ static void popFrontUntilEqual(QList<QMap<QString, QString> >& list,
     list.pop_front();
 }
 
-void GirderFileBrowserFetcher::getRootPath()
+GirderFuture<bool> GirderFileBrowserFetcher::getRootPath(
+  const QList<QMap<QString, QString> >* knownRootPath)
 {
   // Cache some info in case there is an interruption or error
   m_cachedRootPath.first = true;
   m_cachedRootPath.second = m_currentRootPath;
 
+  if (knownRootPath)
+  {
+    m_currentRootPath = *knownRootPath;
+    return GirderFuture<bool>::resolved(true);
+  }
+
   // Skip the root path check if the previous parent was the same as the current one
   if (m_currentParentInfo == m_previousParentInfo)
-    return;
+    return GirderFuture<bool>::resolved(true);
 
   // Skip the root path check if the current parent is the actual root
   if (!m_customRootInfo.isEmpty() && m_currentParentInfo == m_customRootInfo)
   {
     m_currentRootPath.clear();
-    return;
+    return GirderFuture<bool>::resolved(true);
   }
 
   // To potentially skip an api call, check if the  parent is already
@@ -549,7 +934,7 @@ void GirderFileBrowserFetcher::getRootPath()
     while (m_currentRootPath.back() != m_currentParentInfo)
       m_currentRootPath.pop_back();
     m_currentRootPath.pop_back();
-    return;
+    return GirderFuture<bool>::resolved(true);
   }
 
   // Parent type must be folder or item, or this cannot be called.
@@ -557,91 +942,739 @@ void GirderFileBrowserFetcher::getRootPath()
   {
     m_currentRootPath.clear();
     prependNeededRootPathItems();
-    return;
+    return GirderFuture<bool>::resolved(true);
   }
 
   // To also potentially skip an api call, check if the current parent was in
   // the previous set of folders or items. If it was, then we just moved down
   // one directory. Skip the root path call and set it manually.
-  if (currentParentType() == "folder" && m_previousFolders.keys().contains(currentParentId()))
+  if (currentParentType() == "folder" && m_previousFolders.contains(currentParentId()))
   {
     m_currentRootPath.append(m_previousParentInfo);
-    return;
+    return GirderFuture<bool>::resolved(true);
   }
 
-  if (currentParentType() == "item" && m_previousItems.keys().contains(currentParentId()))
+  if (currentParentType() == "item" && m_previousItems.contains(currentParentId()))
   {
     m_currentRootPath.append(m_previousParentInfo);
-    return;
+    return GirderFuture<bool>::resolved(true);
   }
 
   m_currentRootPath.clear();
 
-  std::unique_ptr<GetRootPathRequest> getRootPathRequest(new GetRootPathRequest(
-    m_networkManager, m_apiUrl, m_girderToken, currentParentId(), currentParentType()));
-
-  sendAndConnect(getRootPathRequest.get(),
-    &GetRootPathRequest::rootPath,
-    this,
-    [this](const QList<QMap<QString, QString> >& rootPath) {
-      m_currentRootPath = rootPath;
-      prependNeededRootPathItems();
-      // If there is a custom root, remove all items till we hit that one
-      if (!m_customRootInfo.isEmpty())
-        popFrontUntilEqual(m_currentRootPath, m_customRootInfo);
-      m_folderRequestPending["rootPath"] = false;
-      finishGettingFolderInformationIfReady();
+  // Build as much of the root path as we can from objects we saw before
+  QList<QMap<QString, QString> > knownPath;
+  QMap<QString, QString> missing;
+  if (m_ancestorIndex.rootPath(
+        m_currentParentInfo, knownPath, missing, m_customRootInfo.value("id")))
+  {
+    m_currentRootPath = knownPath;
+    prependNeededRootPathItems();
+    if (!m_customRootInfo.isEmpty())
+      popFrontUntilEqual(m_currentRootPath, m_customRootInfo);
+    return GirderFuture<bool>::resolved(true);
+  }
+
+  // Only ask for the part above the first unknown link
+  if (missing != m_currentParentInfo)
+    knownPath.prepend(missing);
+
+  // Offline, the part above it is left out
+  if (!shouldRequest())
+  {
+    useKnownRootPath(knownPath);
+    return GirderFuture<bool>::resolved(true);
+  }
+
+  GetRootPathRequest* getRootPathRequest = addRequest(new GetRootPathRequest(
+    m_networkManager, m_apiUrl, m_girderToken, missing.value("id"), missing.value("type")));
+
+  GirderPromise<bool> promise;
+  withErrorPrefix(sendAsync(getRootPathRequest, &GetRootPathRequest::rootPath),
+    "An error occurred while updating the root path:\n")
+    .subscribe(
+      [this, missing, knownPath, promise](const QList<QMap<QString, QString> >& rootPath) {
+        setUnreachable(false);
+        m_ancestorIndex.addRootPath(rootPath, missing);
+        m_currentRootPath = rootPath + knownPath;
+        prependNeededRootPathItems();
+        // If there is a custom root, remove all items till we hit that one
+        if (!m_customRootInfo.isEmpty())
+          popFrontUntilEqual(m_currentRootPath, m_customRootInfo);
+        promise.resolve(true);
+      },
+      [this, knownPath, promise](const QString& message) {
+        if (!isOffline())
+        {
+          promise.reject(message);
+          return;
+        }
+        useKnownRootPath(knownPath);
+        promise.resolve(true);
+      });
+  return promise.future();
+}
+
+void GirderFileBrowserFetcher::useKnownRootPath(const QList<QMap<QString, QString> >& knownPath)
+{
+  m_currentRootPath = knownPath;
+  prependNeededRootPathItems();
+  if (!m_customRootInfo.isEmpty())
+    popFrontUntilEqual(m_currentRootPath, m_customRootInfo);
+}
+
+template<typename Request, typename Owner, typename Result>
+GirderFuture<GirderListing> GirderFileBrowserFetcher::prefetch(const QString& key,
+  Request* request,
+  void (Owner::*resultSignal)(const Result&),
+  GirderRateLimiter::TrafficClass trafficClass,
+  bool warming)
+{
+  request->setParent(this);
+  request->setTrafficClass(trafficClass);
+  connect(request, &Request::unauthorized, this, [this]() {
+    m_listingCache.clear();
+    clearAllRequestsAndRestorePreviousState();
+    emit authenticationRequired();
+  });
+  connect(request, &Request::error, this, [this](const QString&, QNetworkReply* reply) {
+    noteNetworkFailure(reply);
+  });
+
+  traceStartup(QString("requested %1").arg(key));
+  if (warming)
+  {
+    m_ancestorRequests[key] = request;
+    ++m_ancestorListingsIssued;
+  }
+  else
+  {
+    ++m_prefetchesIssued;
+  }
+
+  GirderFuture<GirderListing> future = sendAsync(request, resultSignal)
+    .then([](const Result& result) { return cachedListing(result); });
+  future.subscribe(
+    [this, key, request, warming](const GirderListing& listing) {
+      traceStartup(QString("received %1").arg(key));
+      m_listingStore.insert(key, listing, highWaterMark(request));
+      if (warming)
+      {
+        m_ancestorRequests.remove(key);
+      }
+      else if (m_listingCache.contains(key))
+      {
+        UnusedPrefetch& unused = m_unusedPrefetches[key];
+        unused.bytes = request->bytesReceived();
+        unused.age.start();
+      }
+      else
+      {
+        // It was taken while still in flight
+        m_prefetchUsedBytes += request->bytesReceived();
+        reportPrefetchStatistics();
+      }
+      request->deleteLater();
+    },
+    [this, key, request, warming](const QString&) {
+      traceStartup(QString("failed %1").arg(key));
+      if (warming)
+        m_ancestorRequests.remove(key);
+      request->deleteLater();
     });
 
-  m_girderRequests[GET_ROOT_PATH_REQUEST] = std::move(getRootPathRequest);
-  m_folderRequestPending["rootPath"] = true;
+  m_listingCache.insert(key, future);
+  return future;
 }
 
-void GirderFileBrowserFetcher::errorReceived(const QString& message)
+GirderFuture<GirderListingCache::Listing> GirderFileBrowserFetcher::takePrefetched(
+  const QString& key)
 {
-  // First, clear the requests so no new error is produced from the
-  // current set of updates, and restore the previous state.
-  clearAllRequestsAndRestorePreviousState();
+  GirderFuture<GirderListing> future = m_listingCache.take(key);
+  if (!future.isValid())
+  {
+    GirderListingCache::Listing listing;
+    if (m_listingStore.find(key, listing))
+    {
+      traceStartup(QString("using stored %1").arg(key));
+      return GirderFuture<GirderListingCache::Listing>::resolved(listing);
+    }
+
+    traceStartup(QString("not prefetched %1").arg(key));
+    return GirderFuture<GirderListingCache::Listing>();
+  }
+
+  traceStartup(QString("%1 %2").arg(future.isFinished() ? "using" : "waiting for").arg(key));
+  // Listings kept by keepListing() or warmed as ancestors were not
+  // prefetched
+  if (m_unusedPrefetches.contains(key) ||
+    (!future.isFinished() && !m_ancestorRequests.contains(key)))
+    ++m_prefetchHits;
+  if (m_unusedPrefetches.contains(key))
+    m_prefetchUsedBytes += m_unusedPrefetches.take(key).bytes;
+  m_speculativeRequests.remove(key);
+  m_predictedRequests.remove(key);
+  reportPrefetchStatistics();
+
+  int generation = m_requestGeneration;
+  GirderPromise<GirderListingCache::Listing> promise;
+  future.subscribe(
+    [this, generation, promise](const GirderListing& listing) {
+      if (generation == m_requestGeneration)
+        promise.resolve(listing);
+    },
+    [this, generation, promise](const QString& message) {
+      if (generation == m_requestGeneration)
+        promise.reject(message);
+    });
+  return promise.future();
+}
+
+void GirderFileBrowserFetcher::prefetchStartup(const QMap<QString, QString>& startFolder)
+{
+  m_startupClock.start();
+  traceStartup(QString("loaded %1 stored listings in %2 ms")
+                 .arg(m_listingStore.size())
+                 .arg(m_listingStore.loadMsecs()));
+  traceStartup("prefetching");
+
+  if (!shouldRequest())
+    return;
 
-  QObject* sender = QObject::sender();
-  QString completeMessage;
-  if (sender == m_girderRequests[GET_FOLDERS_REQUEST].get())
+  // The top levels are only reachable without a custom root
+  if (m_customRootInfo.isEmpty())
   {
-    completeMessage += "An error occurred while getting folders:\n";
+    // Going home needs the user first, and then the home listing
+    prefetch(GirderListingCache::myUserKey(),
+      new GetMyUserRequest(m_networkManager, m_apiUrl, m_girderToken),
+      &GetMyUserRequest::myUser)
+      .subscribe(
+        [this](const GirderListing& myUser) {
+          QString key = GirderListingCache::foldersKey("user", myUser.key(0));
+          if (!isListingCached(key))
+          {
+            prefetch(key,
+              new ListFoldersRequest(
+                m_networkManager, m_apiUrl, m_girderToken, myUser.key(0), "user"),
+              &ListFoldersRequest::listing);
+          }
+        },
+        [](const QString&) {});
+
+    // Listings stored recently enough are not requested again
+    if (!isListingCached(GirderListingCache::usersKey()))
+    {
+      prefetch(GirderListingCache::usersKey(),
+        new GetUsersRequest(m_networkManager, m_apiUrl, m_girderToken),
+        &GetUsersRequest::listing);
+    }
+
+    if (!isListingCached(GirderListingCache::collectionsKey()))
+    {
+      prefetch(GirderListingCache::collectionsKey(),
+        new GetCollectionsRequest(m_networkManager, m_apiUrl, m_girderToken),
+        &GetCollectionsRequest::listing);
+    }
   }
-  else if (sender == m_girderRequests[GET_ITEMS_REQUEST].get())
+
+  QString type = startFolder.value("type");
+  QString id = startFolder.value("id");
+  if (id.isEmpty())
+    return;
+
+  if ((type == "folder" || type == "user" || type == "collection") &&
+    !isListingCached(GirderListingCache::foldersKey(type, id)))
   {
-    completeMessage += "An error occurred while getting items:\n";
+    prefetch(GirderListingCache::foldersKey(type, id),
+      new ListFoldersRequest(m_networkManager, m_apiUrl, m_girderToken, id, type),
+      &ListFoldersRequest::listing);
   }
-  else if (sender == m_girderRequests[GET_FILES_REQUEST].get())
+
+  if (type == "folder" && !isListingCached(GirderListingCache::itemsKey(id)))
   {
-    completeMessage += "An error occurred while getting files:\n";
+    prefetch(GirderListingCache::itemsKey(id),
+      new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, id),
+      &ListItemsRequest::listing);
   }
-  else if (sender == m_girderRequests[GET_ROOT_PATH_REQUEST].get())
+}
+
+void GirderFileBrowserFetcher::prefetchFolder(const QMap<QString, QString>& folderInfo)
+{
+  prefetchListings(folderInfo, m_speculativeRequests);
+}
+
+void GirderFileBrowserFetcher::prefetchListings(const QMap<QString, QString>& folderInfo,
+  QHash<QString, QPointer<GirderRequest> >& requests)
+{
+  if (unusedPrefetchBytes() < m_prefetchByteBudget)
+    fetchListings(folderInfo, requests);
+}
+
+void GirderFileBrowserFetcher::fetchListings(const QMap<QString, QString>& folderInfo,
+  QHash<QString, QPointer<GirderRequest> >& requests, bool warming)
+{
+  QString type = folderInfo.value("type");
+  QString id = folderInfo.value("id");
+  if (id.isEmpty() || isOffline())
+    return;
+
+  // Nobody is waiting for these, so they use the background budget
+  auto background = GirderRateLimiter::TrafficClass::metadata;
+
+  if (type == "folder" || type == "user" || type == "collection")
   {
-    completeMessage += "An error occurred while updating the root path:\n";
+    QString key = GirderListingCache::foldersKey(type, id);
+    if (isListingWanted(key))
+    {
+      auto* request = new ListFoldersRequest(m_networkManager, m_apiUrl, m_girderToken, id, type);
+      prefetch(key, request, &ListFoldersRequest::listing, background, warming);
+      requests[key] = request;
+    }
   }
-  else if (sender == m_girderRequests[GET_USERS_REQUEST].get())
+
+  if (type == "folder")
   {
-    completeMessage += "An error occurred while getting users:\n";
+    QString key = GirderListingCache::itemsKey(id);
+    if (isListingWanted(key))
+    {
+      auto* request = new ListItemsRequest(m_networkManager, m_apiUrl, m_girderToken, id);
+      prefetch(key, request, &ListItemsRequest::listing, background, warming);
+      requests[key] = request;
+    }
   }
-  else if (sender == m_girderRequests[GET_COLLECTIONS_REQUEST].get())
+
+  if (type == "item" && treatItemsAsFolders())
   {
-    completeMessage += "An error occurred while getting collections:\n";
+    QString key = GirderListingCache::filesKey(id);
+    if (isListingWanted(key))
+    {
+      auto* request = new ListFilesRequest(m_networkManager, m_apiUrl, m_girderToken, id);
+      prefetch(key, request, &ListFilesRequest::listing, background, warming);
+      requests[key] = request;
+    }
   }
-  else if (sender == m_girderRequests[GET_MY_USER_REQUEST].get())
+}
+
+void GirderFileBrowserFetcher::cancelPrefetches(
+  QHash<QString, QPointer<GirderRequest> >& requests)
+{
+  for (auto it = requests.begin(); it != requests.end(); ++it)
   {
-    completeMessage += "Failed to get information about current user:\n";
+    // Finished ones stay in the cache, they cost nothing more
+    GirderRequest* request = it.value();
+    if (!request || !m_listingCache.isPending(it.key()))
+      continue;
+
+    m_prefetchWastedBytes += request->bytesReceived();
+    m_listingCache.remove(it.key());
+    request->disconnect();
+    request->deleteLater();
   }
-  else if (!m_itemContentsRequests.empty() &&
-    std::any_of(m_itemContentsRequests.cbegin(),
-      m_itemContentsRequests.cend(),
-      [sender](const std::unique_ptr<GirderRequest>& uPtr) { return uPtr.get() == sender; }))
+  requests.clear();
+  reportPrefetchStatistics();
+}
+
+void GirderFileBrowserFetcher::predictNextFolders()
+{
+  // Opening the same folder again (such as after changing the item mode)
+  // is not a move
+  if (!m_previousParentInfo.isEmpty() && m_previousParentInfo != m_currentParentInfo)
+    m_navigationPredictor.recordTransition(m_previousParentInfo, m_currentParentInfo);
+
+  if (m_predictivePrefetchCount <= 0)
+    return;
+
+  for (const auto& folder :
+    m_navigationPredictor.predict(m_currentParentInfo, m_predictivePrefetchCount))
   {
-    m_itemContentsRequests.clear();
-    completeMessage += "Failed to get one of the item's contents:\n";
+    prefetchListings(folder, m_predictedRequests);
   }
-  completeMessage += message;
+}
+
+void GirderFileBrowserFetcher::keepListing(const QString& key,
+  const GirderListingCache::Listing& listing)
+{
+  m_unusedPrefetches.remove(key);
+  m_listingCache.insert(key, GirderFuture<GirderListing>::resolved(listing));
+  m_listingStore.insert(key, listing);
+}
+
+bool GirderFileBrowserFetcher::isListingCached(const QString& key)
+{
+  return m_listingCache.contains(key) || m_listingStore.contains(key);
+}
+
+bool GirderFileBrowserFetcher::isListingWanted(const QString& key)
+{
+  // A warmed listing taken while in flight is no longer in the cache
+  return !isListingCached(key) && !m_ancestorRequests.value(key);
+}
+
+void GirderFileBrowserFetcher::warmAncestorListings(
+  const QList<QMap<QString, QString> >& rootPath)
+{
+  if (isOffline())
+    return;
+
+  // Nobody is waiting for these, and they are not cancelled when the user
+  // moves on: the ancestors of the next folder are mostly the same. Those
+  // still in flight from the last folder change are not asked again.
+  auto background = GirderRateLimiter::TrafficClass::metadata;
+
+  for (const auto& ancestor : rootPath)
+  {
+    QString type = ancestor.value("type");
+    if (type == "Users")
+    {
+      if (isListingWanted(GirderListingCache::usersKey()))
+      {
+        prefetch(GirderListingCache::usersKey(),
+          new GetUsersRequest(m_networkManager, m_apiUrl, m_girderToken),
+          &GetUsersRequest::listing,
+          background,
+          true);
+      }
+    }
+    else if (type == "Collections")
+    {
+      if (isListingWanted(GirderListingCache::collectionsKey()))
+      {
+        prefetch(GirderListingCache::collectionsKey(),
+          new GetCollectionsRequest(m_networkManager, m_apiUrl, m_girderToken),
+          &GetCollectionsRequest::listing,
+          background,
+          true);
+      }
+    }
+    else
+    {
+      fetchListings(ancestor, m_ancestorRequests, true);
+    }
+  }
+}
+
+qint64 GirderFileBrowserFetcher::unusedPrefetchBytes()
+{
+  qint64 bytes = 0;
+  bool wasted = false;
+  for (auto it = m_unusedPrefetches.begin(); it != m_unusedPrefetches.end();)
+  {
+    if (it->age.elapsed() > m_listingCache.maxAge())
+    {
+      m_prefetchWastedBytes += it->bytes;
+      wasted = true;
+      it = m_unusedPrefetches.erase(it);
+      continue;
+    }
+
+    bytes += it->bytes;
+    ++it;
+  }
+
+  if (wasted)
+    reportPrefetchStatistics();
+
+  return bytes;
+}
+
+void GirderFileBrowserFetcher::reportPrefetchStatistics()
+{
+  emit prefetchStatistics(
+    m_prefetchesIssued, m_prefetchHits, m_prefetchUsedBytes, m_prefetchWastedBytes);
+}
+
+void GirderFileBrowserFetcher::traceStartup(const QString& event)
+{
+  if (m_startupClock.isValid())
+    emit startupTrace(event, m_startupClock.elapsed());
+}
+
+void GirderFileBrowserFetcher::setGirderToken(const QString& token)
+{
+  m_girderToken = token;
+
+  // Polling stopped by the old token goes on with this one
+  if (m_changePollInterval > 0 && !m_changePollTimer->isActive())
+    m_changePollTimer->start(m_changePollInterval);
+}
+
+void GirderFileBrowserFetcher::setChangePollInterval(int msecs)
+{
+  m_changePollInterval = qMax(msecs, 0);
+  if (msecs > 0)
+    m_changePollTimer->start(msecs);
+  else
+    m_changePollTimer->stop();
+}
+
+void GirderFileBrowserFetcher::pollForChanges()
+{
+  if (isOffline() || m_polling)
+    return;
+
+  // Files of items have no delta listing, and the top levels are not
+  // girder objects
+  // These are <key, child type>
+  QList<QPair<QString, QString> > listings;
+  QString type = currentParentType();
+  QString id = currentParentId();
+  if (type == "folder" || type == "user" || type == "collection")
+    listings.append(qMakePair(GirderListingCache::foldersKey(type, id), QString("folder")));
+  if (type == "folder")
+    listings.append(qMakePair(GirderListingCache::itemsKey(id), QString("item")));
+  if (listings.isEmpty())
+    return;
+
+  clearPollRequests();
+  m_polling = true;
+
+  QMap<QString, QString> parentInfo = m_currentParentInfo;
+  auto changed = std::make_shared<bool>(false);
+  QList<GirderFuture<bool> > parts;
+  for (const auto& listing : listings)
+  {
+    QString key = listing.first;
+    QString childType = listing.second;
+
+    // What is shown was stored when it was listed
+    GirderListingCache::Listing before;
+    QString highWaterMark;
+    m_listingStore.findForRefresh(key, before, highWaterMark);
+
+    // A small listing without a mark is simply listed again
+    GirderFuture<GirderListingCache::Listing> after =
+      refreshStoredListing(key, childType, 1, true);
+    if (!after.isValid())
+      after = requestListing(key, childType, true);
+
+    parts.append(after.then([this, key, childType, before, changed, parentInfo](
+                              const GirderListingCache::Listing& listing) {
+      if (listing == before)
+        return;
+
+      *changed = true;
+      if (parentInfo == m_currentParentInfo)
+        updateCurrentListing(childType, before, listing);
+      forgetRemovedChildren(childType, before, listing);
+      // Opening the folder again picks this up instead of the old one
+      keepListing(key, listing);
+    }));
+  }
+
+  // The folder is not opened again: only its rows change
+  whenAll(parts).subscribe(
+    [this, parentInfo, changed](const QList<bool>&) {
+      m_polling = false;
+      if (!*changed || parentInfo != m_currentParentInfo)
+        return;
+
+      QList<QMap<QString, QString> > folders;
+      QList<QMap<QString, QString> > files;
+      currentRows(folders, files);
+      m_listingStore.save();
+      emit folderContentsChanged(m_currentParentInfo, folders, files);
+    },
+    [this](const QString& message) {
+      m_polling = false;
+      qDebug() << "Failed to check the current folder for changes:" << message;
+    });
+}
+
+void GirderFileBrowserFetcher::clearPollRequests()
+{
+  for (GirderRequest* request : m_pollRequests)
+  {
+    if (!request)
+      continue;
+
+    request->disconnect();
+    request->deleteLater();
+  }
+  m_pollRequests.clear();
+  m_polling = false;
+}
+
+void GirderFileBrowserFetcher::stopPolling()
+{
+  // Nobody is waiting for the poll, so the user is not asked for a new
+  // token. Whatever asks the server next does that.
+  clearPollRequests();
+  m_changePollTimer->stop();
+}
+
+void GirderFileBrowserFetcher::updateCurrentListing(const QString& childType,
+  const GirderListingCache::Listing& before,
+  const GirderListingCache::Listing& after)
+{
+  if (childType == "folder")
+  {
+    m_currentFolders = after;
+    return;
+  }
+
+  // With file bumping, the items that are not shown were bumped. They stay
+  // bumped while they are listed the same, and new items are shown as
+  // items until the folder is opened again.
+  GirderListingCache::Listing items = after;
+  for (int row = 0; row < before.size(); ++row)
+  {
+    QString itemId = before.key(row);
+    if (m_currentItems.contains(itemId))
+      continue;
+
+    if (after.contains(itemId) && after.value(itemId) == before.value(row))
+    {
+      items.remove(itemId);
+      continue;
+    }
+
+    // Its file goes with it
+    GirderListingCache::Listing files;
+    QString highWaterMark;
+    m_listingStore.findForRefresh(GirderListingCache::filesKey(itemId), files, highWaterMark);
+    for (int file = 0; file < files.size(); ++file)
+      m_currentFiles.remove(files.key(file));
+  }
+  m_currentItems = items;
+}
+
+void GirderFileBrowserFetcher::forgetRemovedChildren(const QString& childType,
+  const GirderListingCache::Listing& before,
+  const GirderListingCache::Listing& after)
+{
+  for (int row = 0; row < before.size(); ++row)
+  {
+    QString id = before.key(row);
+    if (after.contains(id))
+      continue;
+
+    // Its listings and its place in root paths may be wrong now
+    QStringList keys;
+    if (childType == "folder")
+    {
+      keys.append(GirderListingCache::foldersKey("folder", id));
+      keys.append(GirderListingCache::itemsKey(id));
+    }
+    else
+    {
+      keys.append(GirderListingCache::filesKey(id));
+    }
+
+    for (const QString& key : keys)
+    {
+      m_listingCache.remove(key);
+      m_unusedPrefetches.remove(key);
+      if (m_listingStore.age(key) >= 0)
+        m_listingStore.remove(key);
+    }
+    m_ancestorIndex.remove(id);
+  }
+
+  // Renamed children are updated by the next listing
+}
+
+void GirderFileBrowserFetcher::setOffline(bool offline)
+{
+  bool wasOffline = isOffline();
+  m_forcedOffline = offline;
+  // Going online tries the server right away
+  if (!offline)
+    m_unreachable = false;
+  if (isOffline() != wasOffline)
+    emit offlineChanged(isOffline());
+}
+
+void GirderFileBrowserFetcher::setUnreachable(bool unreachable)
+{
+  bool wasOffline = isOffline();
+  m_unreachable = unreachable;
+  if (unreachable)
+    m_unreachableSince.start();
+  if (isOffline() != wasOffline)
+    emit offlineChanged(isOffline());
+}
+
+void GirderFileBrowserFetcher::noteNetworkFailure(QNetworkReply* reply)
+{
+  if (!reply)
+    return;
+
+  // Errors of the server itself, such as a folder that does not exist,
+  // are not fixed by what is stored
+  switch (reply->error())
+  {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::HostNotFoundError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::UnknownNetworkError:
+    case QNetworkReply::ProxyConnectionRefusedError:
+    case QNetworkReply::ProxyNotFoundError:
+    case QNetworkReply::ProxyTimeoutError:
+      setUnreachable(true);
+      break;
+    default:
+      break;
+  }
+}
+
+bool GirderFileBrowserFetcher::shouldRequest() const
+{
+  if (m_forcedOffline)
+    return false;
+  return !m_unreachable || m_unreachableSince.elapsed() >= m_offlineRetryInterval;
+}
+
+GirderFuture<GirderListingCache::Listing> GirderFileBrowserFetcher::storedListing(
+  const QString& key)
+{
+  GirderListingCache::Listing listing;
+  QString highWaterMark;
+  if (!m_listingStore.findForRefresh(key, listing, highWaterMark))
+    return GirderFuture<GirderListingCache::Listing>::rejected(
+      "This folder was not stored, and the server cannot be reached.");
+
+  traceStartup(QString("using stored %1 offline").arg(key));
+  m_offlineListingAge = qMax(m_offlineListingAge, m_listingStore.age(key));
+  return GirderFuture<GirderListingCache::Listing>::resolved(listing);
+}
+
+GirderFuture<GirderListingCache::Listing> GirderFileBrowserFetcher::orStoredListing(
+  const QString& key,
+  const GirderFuture<GirderListingCache::Listing>& future)
+{
+  // Only a future that is still pending waits for the server
+  bool fromServer = !future.isFinished();
+
+  GirderPromise<GirderListingCache::Listing> promise;
+  future.subscribe(
+    [this, fromServer, promise](const GirderListingCache::Listing& listing) {
+      if (fromServer)
+        setUnreachable(false);
+      promise.resolve(listing);
+    },
+    [this, key, promise](const QString& message) {
+      if (!isOffline())
+      {
+        promise.reject(message);
+        return;
+      }
+
+      storedListing(key).subscribe(
+        [promise](const GirderListingCache::Listing& listing) { promise.resolve(listing); },
+        [promise, message](const QString&) { promise.reject(message); });
+    });
+  return promise.future();
+}
+
+void GirderFileBrowserFetcher::errorReceived(const QString& message)
+{
+  // First, clear the requests so no new error is produced from the
+  // current set of updates, and restore the previous state.
+  clearAllRequestsAndRestorePreviousState();
+
   emit error(message);
 }
 
@@ -14,15 +14,27 @@
 #ifndef girderfilebrowser_girderfilebrowserfetcher_h
 #define girderfilebrowser_girderfilebrowserfetcher_h
 
+#include <QElapsedTimer>
+#include <QHash>
 #include <QMap>
 #include <QObject>
 #include <QPair>
+#include <QPointer>
 #include <QString>
 
-#include <map>
 #include <memory>
+#include <vector>
+
+#include "girderancestorindex.h"
+#include "girderfuture.h"
+#include "girderlistingcache.h"
+#include "girderlistingstore.h"
+#include "girdernavigationpredictor.h"
+#include "girderratelimiter.h"
 
 class QNetworkAccessManager;
+class QNetworkReply;
+class QTimer;
 
 namespace cumulus
 {
@@ -39,8 +51,8 @@ public:
 
   virtual ~GirderFileBrowserFetcher() override;
 
-  void setApiUrl(const QString& url) { m_apiUrl = url; }
-  void setGirderToken(const QString& token) { m_girderToken = token; }
+  void setApiUrl(const QString& url);
+  void setGirderToken(const QString& token);
 
   // Our different modes for treating items. Default is "treatItemsAsFiles".
   enum class ItemMode {
@@ -59,16 +71,100 @@ public:
   // Set the root folder. Do not set this unless using a custom root folder.
   void setCustomRootInfo(const QMap<QString, QString>& rootInfo) { m_customRootInfo = rootInfo; }
 
+  // A root path known from elsewhere, such as a GirderTreeIndex. Opening
+  // object then needs no root path request.
+  void addRootPath(const QList<QMap<QString, QString> >& rootPath,
+    const QMap<QString, QString>& object)
+  {
+    m_ancestorIndex.addRootPath(rootPath, object);
+  }
+
+  // Prefetched listings that were never opened cost bandwidth for
+  // nothing. prefetchFolder() stops once the bytes of the unused ones,
+  // over the lifetime of the listing cache, exceed this budget.
+  void setPrefetchByteBudget(qint64 bytes) { m_prefetchByteBudget = bytes; }
+  qint64 prefetchByteBudget() const { return m_prefetchByteBudget; }
+
+  // After every folder change, prefetch up to this many of the folders
+  // that were most often opened next from there before. 0 disables it.
+  void setPredictivePrefetchCount(int count) { m_predictivePrefetchCount = count; }
+  int predictivePrefetchCount() const { return m_predictivePrefetchCount; }
+
+  // The number of ancestor listings fetched so that going up is instant.
+  // They are not counted as prefetches.
+  int ancestorListingsIssued() const { return m_ancestorListingsIssued; }
+
+  // Listings are also kept on disk, and those stored less than this long
+  // ago are shown without asking the server, in msecs. 0 disables it.
+  void setStoredListingMaxAge(qint64 msecs) { m_listingStore.setMaxAge(msecs); }
+  qint64 storedListingMaxAge() const { return m_listingStore.maxAge(); }
+
+  // Stored folder and item listings of at least this many entries are not
+  // listed again once too old. Only what was updated since is listed, and
+  // a count of the contents tells whether anything was removed. 0 disables
+  // it.
+  void setDeltaRefreshMinimumSize(int size) { m_deltaRefreshMinimumSize = size; }
+  int deltaRefreshMinimumSize() const { return m_deltaRefreshMinimumSize; }
+
+  // Offline, listings and root paths only come from what is stored,
+  // whatever its age, and nothing is requested. The fetcher also goes
+  // offline by itself when the server cannot be reached, in which case it
+  // tries the server again at most every offlineRetryInterval() msecs,
+  // and goes back online once it answers.
+  void setOffline(bool offline);
+  bool isOffline() const { return m_forcedOffline || m_unreachable; }
+  void setOfflineRetryInterval(qint64 msecs) { m_offlineRetryInterval = msecs; }
+  qint64 offlineRetryInterval() const { return m_offlineRetryInterval; }
+
+  // How old the oldest stored listing used offline by the last
+  // folderInformation() is, in msecs, or -1 if none was
+  qint64 offlineListingAge() const { return m_offlineListingAge; }
+
+  // Every msecs, check whether the contents of the current folder changed,
+  // with a delta listing and a count of its contents. If they did, only
+  // the listings and ancestor index entries they affect are dropped, and
+  // folderContentsChanged() is emitted. 0, the default, disables it.
+  // Polling stops if the girder token expires, until a new one is set.
+  void setChangePollInterval(int msecs);
+  int changePollInterval() const { return m_changePollInterval; }
+
 signals:
-  // Emitted when getFolderInformation() is complete
+  // Emitted when getFolderInformation() is complete. The lists are built
+  // once per listing and shared by the fetcher and whoever keeps them, so
+  // copying them is cheap, while changing them makes a copy.
   void folderInformation(const QMap<QString, QString>& parentInfo,
     const QList<QMap<QString, QString> >& folders,
     const QList<QMap<QString, QString> >& files,
     const QList<QMap<QString, QString> >& rootPath);
 
+  // Emitted when the contents of the current folder changed on the
+  // server, with its rows as in folderInformation(). Nothing else about
+  // the current folder changed.
+  void folderContentsChanged(const QMap<QString, QString>& parentInfo,
+    const QList<QMap<QString, QString> >& folders,
+    const QList<QMap<QString, QString> >& files);
+
   // Emitted when there is an error
   void error(const QString& message);
 
+  // Emitted instead of error() when the server rejected the girder token,
+  // for instance because it expired. Set a new token and try again.
+  void authenticationRequired();
+
+  // Emitted for every step between prefetchStartup() and the first
+  // folderInformation(), with the msecs since prefetchStartup(). This
+  // shows which requests the first listing actually waited for.
+  void startupTrace(const QString& event, qint64 msecs);
+
+  // Emitted whenever the prefetch statistics change. issued is the number
+  // of prefetched listings, and hits the number of those that were used.
+  // wastedBytes were spent on listings that expired unused or were
+  // cancelled.
+  void prefetchStatistics(int issued, int hits, qint64 usedBytes, qint64 wastedBytes);
+
+  // Emitted when isOffline() changes
+  void offlineChanged(bool offline);
+
 public slots:
   // Emits folderInformation() when it is completed.
   // This map should contain "name", "id", and "type" entries.
@@ -77,26 +173,121 @@ public slots:
   // Get the information about the home folder
   void getHomeFolderInformation();
 
+  // Go to a girder resource path such as /collection/Data/run42/raw. It is
+  // resolved with a single lookup, and the root path is built from its
+  // segments. Since their ids are not known yet, those root path entries
+  // have a "path" key instead, to be passed back here when opened.
+  void getFolderInformationFromPath(const QString& path);
+
+  // The same as getFolderInformation(), for a folder whose root path was
+  // saved, for instance by an earlier session. The saved root path is only
+  // used offline, since the folder may have moved. Like any folder change,
+  // it cancels the one in flight, and the previous folder is kept if it
+  // fails.
+  void revalidateFolderInformation(const QMap<QString, QString>& parentInfo,
+    const QList<QMap<QString, QString> >& rootPath);
+
+  // The rows folderInformation() would have for parentInfo from the
+  // stored listings, however old they are, to show while it is listed
+  // again. Returns false if none of them are stored.
+  bool storedFolderInformation(const QMap<QString, QString>& parentInfo,
+    QList<QMap<QString, QString> >& folders,
+    QList<QMap<QString, QString> >& files);
+
+  // Request everything the first listing might need at once: the current
+  // user and their home folder, the users and collections, and the listing
+  // of startFolder. getFolderInformation() and getHomeFolderInformation()
+  // then pick up whichever of these they need instead of requesting them
+  // one after the other.
+  void prefetchStartup(const QMap<QString, QString>& startFolder);
+
+  // List folderInfo in the background, in case it is opened next. Does
+  // nothing if it is already prefetched, or if the prefetch byte budget
+  // is used up.
+  void prefetchFolder(const QMap<QString, QString>& folderInfo);
+
+  // Abort the background listings of prefetchFolder() that are still in
+  // flight and that nobody is waiting for
+  void cancelSpeculativePrefetches() { cancelPrefetches(m_speculativeRequests); }
+
   // Convenience function for signals
   void setApiUrlAndGirderToken(const QString& apiUrl, const QString& girderToken);
 
-private slots:
+private:
   void errorReceived(const QString& message);
 
-  void finishGettingContainingItems(const QMap<QString, QString>& items);
-  // Only called if m_itemMode is ItemMode::treatItemsAsFoldersWithFileBumping
-  void finishGettingFilesForContainingItems(const QMap<QString, QString>& files, const QString& itemId);
+  // getFolderInformation(), with the root path of parentInfo if it is
+  // known already
+  void openFolder(const QMap<QString, QString>& parentInfo,
+    const QList<QMap<QString, QString> >* knownRootPath);
+
+  // The generic cases. Each of these returns a future that resolves
+  // once its part of the folder information is available.
+  GirderFuture<bool> getContainingFolders();
+  GirderFuture<bool> getContainingItems();
+  GirderFuture<bool> getContainingFiles();
+  // Uses knownRootPath as it is, if it is set
+  GirderFuture<bool> getRootPath(const QList<QMap<QString, QString> >* knownRootPath = nullptr);
+
+  // Only does anything if m_itemMode is ItemMode::treatItemsAsFoldersWithFileBumping
+  GirderFuture<bool> getFilesForContainingItems();
+
+  // List the "folder" or "item" children of the current parent, and store
+  // the listing with its high-water mark. The requests of a poll are made
+  // with addPollRequest() instead of addRequest().
+  GirderFuture<GirderListingCache::Listing> requestListing(const QString& key,
+    const QString& childType,
+    bool polling = false);
+
+  // Bring the stored listing for key up to date with the children updated
+  // after its high-water mark. If the count of children then differs from
+  // the server's, something was removed, and everything is listed again.
+  // The future is invalid if there is no stored listing of at least
+  // minimumSize entries.
+  GirderFuture<GirderListingCache::Listing> refreshStoredListing(const QString& key,
+    const QString& childType,
+    int minimumSize,
+    bool polling = false);
+
+  // See setChangePollInterval()
+  void pollForChanges();
+  // Drop the requests of the last poll, and let the next one go
+  void clearPollRequests();
+  // Stop polling until a new girder token is set
+  void stopPolling();
+  // Show the polled listing of the children of type childType of the
+  // current parent from now on. before is the listing that was shown.
+  void updateCurrentListing(const QString& childType,
+    const GirderListingCache::Listing& before,
+    const GirderListingCache::Listing& after);
+  // Drop what is known about the children of the current parent that are
+  // in before but not in after
+  void forgetRemovedChildren(const QString& childType,
+    const GirderListingCache::Listing& before,
+    const GirderListingCache::Listing& after);
 
-private:
-  // The generic cases
-  void getContainingFolders();
-  void getContainingItems();
-  void getContainingFiles();
-  void getRootPath();
-
-  // Checks to see if all steps are complete and there are no errors
-  void finishGettingFolderInformationIfReady();
   void finishGettingFolderInformation();
+  // The rows of the current folder, as in folderInformation()
+  void currentRows(QList<QMap<QString, QString> >& folders,
+    QList<QMap<QString, QString> >& files);
+
+  // The same, for the listings of the children of parentInfo
+  void listingRows(const QMap<QString, QString>& parentInfo,
+    const GirderListingCache::Listing& folderListing,
+    const GirderListingCache::Listing& itemListing,
+    const GirderListingCache::Listing& fileListing,
+    QList<QMap<QString, QString> >& folders,
+    QList<QMap<QString, QString> >& files);
+
+  // The rows of folderInformation() for a listing of children of type in
+  // parentInfo, sorted by name. The rows of the last listings shown are
+  // kept, and handed out again as long as they are the same.
+  QList<QMap<QString, QString> > rows(const QMap<QString, QString>& parentInfo,
+    const QString& type,
+    const GirderListingCache::Listing& listing);
+
+  // Open the object that the path made of segments resolved to
+  void finishLookingUpPath(const QStringList& segments, const QMap<QString, QString>& objectInfo);
 
   // The special cases in the top two level directories
   void getRootFolderInformation();
@@ -109,7 +300,95 @@ private:
   // A general update function called by getUsersFolderInformation() and
   // getCollectionsFolderInformation()
   void finishGettingSecondLevelFolderInformation(const QString& type,
-    const QMap<QString, QString>& map);
+    const GirderListingCache::Listing& listing);
+
+  // Take ownership of a request. It will be deleted by clearAllRequests().
+  // The user is waiting for these, so they are interactive traffic by
+  // default.
+  template<typename Request>
+  Request* addRequest(Request* request);
+  // The same for the requests of a poll. Nobody is waiting for them, so
+  // they are background traffic, and an expired token stops polling
+  // instead of asking for a new one.
+  template<typename Request>
+  Request* addPollRequest(Request* request);
+  // addPollRequest() if polling, addRequest() otherwise
+  template<typename Request>
+  Request* addRequest(Request* request, bool polling)
+  {
+    return polling ? addPollRequest(request) : addRequest(request);
+  }
+
+  // Send request now and keep its future in m_listingCache under key.
+  // The request is owned by this fetcher, but not by the current folder.
+  // Listings fetched while warming ancestors are not prefetches, and are
+  // left out of the prefetch statistics.
+  template<typename Request, typename Owner, typename Result>
+  GirderFuture<GirderListing> prefetch(const QString& key,
+    Request* request,
+    void (Owner::*resultSignal)(const Result&),
+    GirderRateLimiter::TrafficClass trafficClass = GirderRateLimiter::TrafficClass::interactive,
+    bool warming = false);
+  // What prefetch() keeps for the result of a request. The current user
+  // is kept as <id => login>, the same as it is stored.
+  static GirderListing cachedListing(const GirderListing& listing) { return listing; }
+  static GirderListing cachedListing(const QMap<QString, QString>& myUserInfo);
+
+  // Bytes of prefetched listings that were not taken yet. Those older than
+  // the listing cache's max age are dropped, and counted as wasted.
+  qint64 unusedPrefetchBytes();
+
+  // Prefetch the listings that opening folderInfo would need, in the
+  // background, and keep their requests in requests.
+  // fetchListings() does the same regardless of the byte budget.
+  void prefetchListings(const QMap<QString, QString>& folderInfo,
+    QHash<QString, QPointer<GirderRequest> >& requests);
+  void fetchListings(const QMap<QString, QString>& folderInfo,
+    QHash<QString, QPointer<GirderRequest> >& requests, bool warming = false);
+  // Whether key is neither cached nor already being fetched
+  bool isListingWanted(const QString& key);
+  void cancelPrefetches(QHash<QString, QPointer<GirderRequest> >& requests);
+
+  // Learn from the folder change that just finished, and prefetch where
+  // the user is likely to go next
+  void predictNextFolders();
+
+  void reportPrefetchStatistics();
+
+  // Put a listing from the server back in the listing cache as it is,
+  // whatever the item mode. Coming back to it, such as going up from a
+  // subfolder or changing the item mode, then needs no request.
+  void keepListing(const QString& key, const GirderListingCache::Listing& listing);
+
+  // Whether key is in the listing cache or in the listing store
+  bool isListingCached(const QString& key);
+
+  // Go offline if reply failed because the server cannot be reached
+  void noteNetworkFailure(QNetworkReply* reply);
+  void setUnreachable(bool unreachable);
+  // Whether the server should be asked, or only what is stored used
+  bool shouldRequest() const;
+
+  // The stored listing for key whatever its age. The future fails if
+  // there is none.
+  GirderFuture<GirderListingCache::Listing> storedListing(const QString& key);
+  // future, or the stored listing for key if future fails while offline
+  GirderFuture<GirderListingCache::Listing> orStoredListing(const QString& key,
+    const GirderFuture<GirderListingCache::Listing>& future);
+  // The root path of the current parent as far as the ancestor index
+  // knows it
+  void useKnownRootPath(const QList<QMap<QString, QString> >& knownPath);
+
+  // Fetch the listings of the entries of rootPath that are not cached, so
+  // that going up or following a breadcrumb is instant
+  void warmAncestorListings(const QList<QMap<QString, QString> >& rootPath);
+
+  // Take the prefetched listing for key. The future is invalid if there is
+  // none, in which case the listing has to be requested. Clearing the
+  // requests drops it just like a regular request.
+  GirderFuture<GirderListingCache::Listing> takePrefetched(const QString& key);
+
+  void traceStartup(const QString& event);
 
   // Remove all current requests
   void clearAllRequests();
@@ -126,9 +405,6 @@ private:
   QString currentParentId() const { return m_currentParentInfo.value("id"); }
   QString currentParentType() const { return m_currentParentInfo.value("type"); }
 
-  // Are any folder requests pending?
-  bool folderRequestPending() const;
-
   // Members
   QNetworkAccessManager* m_networkManager;
 
@@ -136,15 +412,23 @@ private:
   QString m_girderToken;
   ItemMode m_itemMode = ItemMode::treatItemsAsFiles;
 
-  // These maps are < id => name >
-  QMap<QString, QString> m_currentFolders;
-  QMap<QString, QString> m_currentItems;
+  // These listings are < id => name >
+  GirderListingCache::Listing m_currentFolders;
+  GirderListingCache::Listing m_currentItems;
   // Each of these QMaps represents a girder object. These maps
   // should all have 3 keys: "name", "id", and "type"
   QList<QMap<QString, QString> > m_currentRootPath;
 
   // Only used if m_itemMode is not ItemMode::treatItemsAsFiles
-  QMap<QString, QString> m_currentFiles;
+  GirderListingCache::Listing m_currentFiles;
+
+  // See rows(), by the type of the children and the parent they are in
+  struct Rows
+  {
+    GirderListingCache::Listing listing;
+    QList<QMap<QString, QString> > rows;
+  };
+  QHash<QString, Rows> m_rows;
 
   // Information about the current parent
   QMap<QString, QString> m_currentParentInfo;
@@ -152,30 +436,74 @@ private:
   // Information about the previous parent, folder, and items are
   // cached to speed up root path functions.
   QMap<QString, QString> m_previousParentInfo;
-  QMap<QString, QString> m_previousFolders;
-  QMap<QString, QString> m_previousItems;
+  GirderListingCache::Listing m_previousFolders;
+  GirderListingCache::Listing m_previousItems;
 
   // Cache these in case there is an error or interruption
   // The bool in the pair indicates whether a cache is available.
   // The second item in the pair is the available data.
   QPair<bool, QMap<QString, QString> > m_cachedPreviousParentInfo;
-  QPair<bool, QMap<QString, QString> > m_cachedPreviousFolders;
-  QPair<bool, QMap<QString, QString> > m_cachedPreviousItems;
+  QPair<bool, GirderListingCache::Listing> m_cachedPreviousFolders;
+  QPair<bool, GirderListingCache::Listing> m_cachedPreviousItems;
   QPair<bool, QList<QMap<QString, QString> > > m_cachedRootPath;
 
   // Our requests.
   // These will be deleted automatically when a new request is made.
-  // We must use a std::map here because QMap has errors with unique_ptr
-  // as value.
-  std::map<QString, std::unique_ptr<GirderRequest> > m_girderRequests;
-
-  // When the item mode is "treatItemsAsFoldersWithFileBumping", we look inside
-  // every item to see if it only contains one file. This variable holds all of
-  // these requests and it is used to check if the requests are completed.
-  std::vector<std::unique_ptr<GirderRequest> > m_itemContentsRequests;
-
-  // Are there any updates pending?
-  QMap<QString, bool> m_folderRequestPending;
+  std::vector<GirderRequest*> m_girderRequests;
+  // Bumped by clearAllRequests() to drop continuations of prefetched
+  // listings that are no longer wanted
+  int m_requestGeneration = 0;
+
+  GirderListingCache m_listingCache;
+
+  // The requests of prefetchFolder(), by listing cache key
+  QHash<QString, QPointer<GirderRequest> > m_speculativeRequests;
+  // The same for predictNextFolders()
+  QHash<QString, QPointer<GirderRequest> > m_predictedRequests;
+  // The same for warmAncestorListings(), while they are in flight
+  QHash<QString, QPointer<GirderRequest> > m_ancestorRequests;
+  int m_ancestorListingsIssued = 0;
+
+  GirderNavigationPredictor m_navigationPredictor;
+  int m_predictivePrefetchCount = 2;
+
+  int m_prefetchesIssued = 0;
+  int m_prefetchHits = 0;
+  qint64 m_prefetchUsedBytes = 0;
+  qint64 m_prefetchWastedBytes = 0;
+
+  struct UnusedPrefetch
+  {
+    qint64 bytes;
+    QElapsedTimer age;
+  };
+  QHash<QString, UnusedPrefetch> m_unusedPrefetches;
+  qint64 m_prefetchByteBudget = 1024 * 1024;
+
+  // Parents of every object seen so far, used to build root paths
+  // without GetRootPathRequest
+  GirderAncestorIndex m_ancestorIndex;
+
+  // Listings from earlier sessions
+  GirderListingStore m_listingStore;
+  int m_deltaRefreshMinimumSize = 1000;
+
+  bool m_forcedOffline = false;
+  bool m_unreachable = false;
+  // Since the server was last tried while unreachable
+  QElapsedTimer m_unreachableSince;
+  qint64 m_offlineRetryInterval = 30 * 1000;
+  qint64 m_offlineListingAge = -1;
+
+  std::unique_ptr<QTimer> m_changePollTimer;
+  int m_changePollInterval = 0;
+  // Set while a poll is out. Its requests are dropped when the folder
+  // changes.
+  bool m_polling = false;
+  QList<QPointer<GirderRequest> > m_pollRequests;
+
+  // Only valid until the first listing after prefetchStartup()
+  QElapsedTimer m_startupClock;
 
   // This should only be set if we have a custom root folder
   QMap<QString, QString> m_customRootInfo;
@@ -192,6 +520,14 @@ inline bool GirderFileBrowserFetcher::treatItemsAsFolders() const
          m_itemMode == ItemMode::treatItemsAsFoldersWithFileBumping;
 }
 
+inline void GirderFileBrowserFetcher::setApiUrl(const QString& url)
+{
+  m_apiUrl = url;
+  m_ancestorIndex.setApiUrl(url);
+  m_listingStore.setApiUrl(url);
+  m_navigationPredictor.setApiUrl(url);
+}
+
 inline void GirderFileBrowserFetcher::setApiUrlAndGirderToken(const QString& url,
   const QString& token)
 {
@@ -199,10 +535,36 @@ inline void GirderFileBrowserFetcher::setApiUrlAndGirderToken(const QString& url
   setGirderToken(token);
 }
 
-inline void GirderFileBrowserFetcher::finishGettingFolderInformationIfReady()
+template<typename Request>
+inline Request* GirderFileBrowserFetcher::addRequest(Request* request)
+{
+  request->setTrafficClass(GirderRateLimiter::TrafficClass::interactive);
+  connect(request, &Request::unauthorized, this, [this]() {
+    // This also drops the error that the request is about to emit
+    clearAllRequestsAndRestorePreviousState();
+    emit authenticationRequired();
+  });
+  // Connected before the future of the request, so that it can fall back
+  // to what is stored
+  connect(request, &Request::error, this, [this](const QString&, QNetworkReply* reply) {
+    noteNetworkFailure(reply);
+  });
+  m_girderRequests.push_back(request);
+  return request;
+}
+
+template<typename Request>
+inline Request* GirderFileBrowserFetcher::addPollRequest(Request* request)
 {
-  if (!folderRequestPending())
-    finishGettingFolderInformation();
+  request->setParent(this);
+  request->setTrafficClass(GirderRateLimiter::TrafficClass::metadata);
+  // This also drops the error that the request is about to emit
+  connect(request, &Request::unauthorized, this, [this]() { stopPolling(); });
+  connect(request, &Request::error, this, [this](const QString&, QNetworkReply* reply) {
+    noteNetworkFailure(reply);
+  });
+  m_pollRequests.append(request);
+  return request;
 }
 
 } // end of namespace
@@ -0,0 +1,354 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderfuture.h
+// .SECTION Description
+// A small single-threaded future/promise pair used to chain girder
+// requests together. Continuations run on the thread that resolves the
+// promise, which is always the gui thread for girder requests.
+// .SECTION See Also
+// sendAsync() in girderrequest.h
+
+#ifndef girderfilebrowser_girderfuture_h
+#define girderfilebrowser_girderfuture_h
+
+#include <QList>
+#include <QString>
+
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace cumulus
+{
+
+template<typename T>
+class GirderFuture;
+
+template<typename T>
+class GirderPromise;
+
+namespace detail
+{
+
+template<typename T>
+struct FutureState
+{
+  bool finished = false;
+  bool failed = false;
+  T value = T();
+  QString errorMessage;
+  std::vector<std::function<void()> > continuations;
+
+  void finish()
+  {
+    finished = true;
+    // A continuation may add continuations of its own, so take them first
+    std::vector<std::function<void()> > pending;
+    pending.swap(continuations);
+    for (auto& continuation : pending)
+      continuation();
+  }
+};
+
+// Defined below. Decides what kind of future GirderFuture::then() returns.
+template<typename R>
+struct ContinuationResult;
+
+} // end namespace detail
+
+template<typename T>
+class GirderPromise
+{
+public:
+  GirderPromise()
+    : m_state(std::make_shared<detail::FutureState<T> >())
+  {
+  }
+
+  GirderFuture<T> future() const { return GirderFuture<T>(m_state); }
+
+  // Only the first call to resolve() or reject() has any effect
+  void resolve(const T& value) const;
+  void reject(const QString& message) const;
+
+  bool isFinished() const { return m_state->finished; }
+
+private:
+  std::shared_ptr<detail::FutureState<T> > m_state;
+};
+
+template<typename T>
+class GirderFuture
+{
+public:
+  // A default constructed future is invalid and never finishes
+  GirderFuture() = default;
+
+  static GirderFuture<T> resolved(const T& value);
+  static GirderFuture<T> rejected(const QString& message);
+
+  bool isValid() const { return static_cast<bool>(m_state); }
+  bool isFinished() const { return m_state && m_state->finished; }
+  bool isFailed() const { return m_state && m_state->failed; }
+
+  // Only meaningful once the future has finished
+  const T& result() const { return m_state->value; }
+  QString errorMessage() const { return m_state->errorMessage; }
+
+  // Call onResult with the value, or onError with the error message,
+  // once this future finishes.
+  template<typename F, typename G>
+  void subscribe(F onResult, G onError) const;
+
+  // Call f with the value once this future succeeds, and return a future
+  // for what f returns. If f returns a GirderFuture<U>, the returned future
+  // is a GirderFuture<U> that finishes when that one does. If f returns
+  // void, the returned future is a GirderFuture<bool> that resolves to true.
+  // Errors skip f and propagate to the returned future.
+  template<typename F>
+  auto then(F f) const -> GirderFuture<
+    typename detail::ContinuationResult<decltype(f(std::declval<const T&>()))>::Type>;
+
+  // Call f with the error message if this future fails. Returns this future.
+  template<typename F>
+  GirderFuture<T> onError(F f) const;
+
+  // Return a future whose error message, if any, is f(errorMessage)
+  template<typename F>
+  GirderFuture<T> mapError(F f) const;
+
+  // Finish promise the same way this future finishes
+  void forward(const GirderPromise<T>& promise) const;
+
+private:
+  friend class GirderPromise<T>;
+
+  explicit GirderFuture(const std::shared_ptr<detail::FutureState<T> >& state)
+    : m_state(state)
+  {
+  }
+
+  void whenFinished(std::function<void()> f) const;
+
+  std::shared_ptr<detail::FutureState<T> > m_state;
+};
+
+namespace detail
+{
+
+template<typename R>
+struct ContinuationResult
+{
+  using Type = R;
+
+  template<typename F, typename Arg>
+  static void run(F& f, const Arg& arg, const GirderPromise<R>& promise)
+  {
+    promise.resolve(f(arg));
+  }
+};
+
+template<typename U>
+struct ContinuationResult<GirderFuture<U> >
+{
+  using Type = U;
+
+  template<typename F, typename Arg>
+  static void run(F& f, const Arg& arg, const GirderPromise<U>& promise)
+  {
+    f(arg).forward(promise);
+  }
+};
+
+template<>
+struct ContinuationResult<void>
+{
+  using Type = bool;
+
+  template<typename F, typename Arg>
+  static void run(F& f, const Arg& arg, const GirderPromise<bool>& promise)
+  {
+    f(arg);
+    promise.resolve(true);
+  }
+};
+
+} // end namespace detail
+
+template<typename T>
+void GirderPromise<T>::resolve(const T& value) const
+{
+  if (m_state->finished)
+    return;
+
+  m_state->value = value;
+  m_state->finish();
+}
+
+template<typename T>
+void GirderPromise<T>::reject(const QString& message) const
+{
+  if (m_state->finished)
+    return;
+
+  m_state->failed = true;
+  m_state->errorMessage = message;
+  m_state->finish();
+}
+
+template<typename T>
+GirderFuture<T> GirderFuture<T>::resolved(const T& value)
+{
+  GirderPromise<T> promise;
+  promise.resolve(value);
+  return promise.future();
+}
+
+template<typename T>
+GirderFuture<T> GirderFuture<T>::rejected(const QString& message)
+{
+  GirderPromise<T> promise;
+  promise.reject(message);
+  return promise.future();
+}
+
+template<typename T>
+void GirderFuture<T>::whenFinished(std::function<void()> f) const
+{
+  if (!m_state)
+    return;
+
+  if (m_state->finished)
+    f();
+  else
+    m_state->continuations.push_back(std::move(f));
+}
+
+template<typename T>
+template<typename F, typename G>
+void GirderFuture<T>::subscribe(F onResult, G onError) const
+{
+  // The state owns the continuation, so a raw pointer to it is safe, and
+  // it avoids a reference cycle.
+  detail::FutureState<T>* state = m_state.get();
+  whenFinished([state, onResult, onError]() mutable {
+    if (state->failed)
+      onError(state->errorMessage);
+    else
+      onResult(state->value);
+  });
+}
+
+template<typename T>
+template<typename F>
+auto GirderFuture<T>::then(F f) const -> GirderFuture<
+  typename detail::ContinuationResult<decltype(f(std::declval<const T&>()))>::Type>
+{
+  using R = decltype(f(std::declval<const T&>()));
+  using U = typename detail::ContinuationResult<R>::Type;
+
+  GirderPromise<U> promise;
+  subscribe(
+    [f, promise](const T& value) mutable {
+      detail::ContinuationResult<R>::run(f, value, promise);
+    },
+    [promise](const QString& message) { promise.reject(message); });
+  return promise.future();
+}
+
+template<typename T>
+template<typename F>
+GirderFuture<T> GirderFuture<T>::onError(F f) const
+{
+  subscribe([](const T&) {}, f);
+  return *this;
+}
+
+template<typename T>
+template<typename F>
+GirderFuture<T> GirderFuture<T>::mapError(F f) const
+{
+  GirderPromise<T> promise;
+  subscribe([promise](const T& value) { promise.resolve(value); },
+    [f, promise](const QString& message) mutable { promise.reject(f(message)); });
+  return promise.future();
+}
+
+template<typename T>
+void GirderFuture<T>::forward(const GirderPromise<T>& promise) const
+{
+  subscribe([promise](const T& value) { promise.resolve(value); },
+    [promise](const QString& message) { promise.reject(message); });
+}
+
+// Returns a future that resolves with every result, in order, once all of
+// the futures have succeeded. It fails as soon as any one of them fails.
+template<typename T>
+GirderFuture<QList<T> > whenAll(const QList<GirderFuture<T> >& futures)
+{
+  GirderPromise<QList<T> > promise;
+  if (futures.isEmpty())
+  {
+    promise.resolve(QList<T>());
+    return promise.future();
+  }
+
+  auto results = std::make_shared<std::vector<T> >(futures.size());
+  auto remaining = std::make_shared<int>(futures.size());
+  for (int i = 0; i < futures.size(); ++i)
+  {
+    futures[i].subscribe(
+      [promise, results, remaining, i](const T& value) {
+        (*results)[i] = value;
+        if (--(*remaining) != 0)
+          return;
+
+        QList<T> list;
+        list.reserve(static_cast<int>(results->size()));
+        for (const auto& result : *results)
+          list.append(result);
+        promise.resolve(list);
+      },
+      [promise](const QString& message) { promise.reject(message); });
+  }
+
+  return promise.future();
+}
+
+// Returns a future that resolves with the first result to arrive. It only
+// fails if all of the futures fail, with the message of the last failure.
+template<typename T>
+GirderFuture<T> whenAny(const QList<GirderFuture<T> >& futures)
+{
+  GirderPromise<T> promise;
+  if (futures.isEmpty())
+  {
+    promise.reject("No futures to wait for.");
+    return promise.future();
+  }
+
+  auto remaining = std::make_shared<int>(futures.size());
+  for (const auto& future : futures)
+  {
+    future.subscribe([promise](const T& value) { promise.resolve(value); },
+      [promise, remaining](const QString& message) {
+        if (--(*remaining) == 0)
+          promise.reject(message);
+      });
+  }
+
+  return promise.future();
+}
+
+} // end namespace
+
+#endif
@@ -0,0 +1,165 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderlisting.h"
+
+#include <algorithm>
+#include <cstring>
+
+namespace cumulus
+{
+
+static int compareBytes(const char* a, int aSize, const char* b, int bSize)
+{
+  int result = std::memcmp(a, b, std::min(aSize, bSize));
+  if (result != 0)
+    return result;
+  return aSize - bSize;
+}
+
+void GirderListing::reserve(int rows, int bytes)
+{
+  m_rows.reserve(m_rows.size() + rows);
+  m_strings.reserve(m_strings.size() + bytes);
+}
+
+void GirderListing::append(const QString& key, const QString& value)
+{
+  append(key.toUtf8(), value.toUtf8());
+}
+
+void GirderListing::append(const QByteArray& key, const QByteArray& value)
+{
+  Row row;
+  row.keyOffset = m_strings.size();
+  row.keySize = key.size();
+  m_strings.append(key);
+  row.valueOffset = m_strings.size();
+  row.valueSize = value.size();
+  m_strings.append(value);
+  m_rows.append(row);
+}
+
+void GirderListing::finish()
+{
+  const char* strings = m_strings.constData();
+  std::stable_sort(m_rows.begin(), m_rows.end(), [strings](const Row& a, const Row& b) {
+    return compareBytes(strings + a.keyOffset, a.keySize, strings + b.keyOffset, b.keySize) < 0;
+  });
+
+  // Keep the last of every run of the same key
+  int kept = 0;
+  for (int i = 0; i < m_rows.size(); ++i)
+  {
+    const Row& row = m_rows[i];
+    if (kept > 0 &&
+      compareBytes(strings + m_rows[kept - 1].keyOffset, m_rows[kept - 1].keySize,
+        strings + row.keyOffset, row.keySize) == 0)
+    {
+      m_rows[kept - 1] = row;
+      continue;
+    }
+
+    m_rows[kept++] = row;
+  }
+  m_rows.resize(kept);
+}
+
+void GirderListing::remove(const QString& key)
+{
+  int row = indexOf(key);
+  if (row >= 0)
+    m_rows.remove(row);
+}
+
+QString GirderListing::key(int row) const
+{
+  const Row& r = m_rows[row];
+  return QString::fromUtf8(m_strings.constData() + r.keyOffset, r.keySize);
+}
+
+QString GirderListing::value(int row) const
+{
+  const Row& r = m_rows[row];
+  return QString::fromUtf8(m_strings.constData() + r.valueOffset, r.valueSize);
+}
+
+QByteArray GirderListing::keyBytes(int row) const
+{
+  const Row& r = m_rows[row];
+  return QByteArray::fromRawData(m_strings.constData() + r.keyOffset, r.keySize);
+}
+
+QByteArray GirderListing::valueBytes(int row) const
+{
+  const Row& r = m_rows[row];
+  return QByteArray::fromRawData(m_strings.constData() + r.valueOffset, r.valueSize);
+}
+
+int GirderListing::compare(const Row& row, const QByteArray& key) const
+{
+  return compareBytes(
+    m_strings.constData() + row.keyOffset, row.keySize, key.constData(), key.size());
+}
+
+int GirderListing::indexOf(const QString& key) const
+{
+  QByteArray bytes = key.toUtf8();
+  auto it = std::lower_bound(m_rows.cbegin(), m_rows.cend(), bytes,
+    [this](const Row& row, const QByteArray& wanted) { return compare(row, wanted) < 0; });
+  if (it == m_rows.cend() || compare(*it, bytes) != 0)
+    return -1;
+  return static_cast<int>(it - m_rows.cbegin());
+}
+
+QString GirderListing::value(const QString& key) const
+{
+  int row = indexOf(key);
+  return row < 0 ? QString() : value(row);
+}
+
+QMap<QString, QString> GirderListing::toMap() const
+{
+  QMap<QString, QString> map;
+  for (int row = 0; row < m_rows.size(); ++row)
+    map.insert(key(row), value(row));
+  return map;
+}
+
+GirderListing GirderListing::fromMap(const QMap<QString, QString>& map)
+{
+  GirderListing listing;
+  listing.m_rows.reserve(map.size());
+  for (auto it = map.cbegin(); it != map.cend(); ++it)
+    listing.append(it.key(), it.value());
+  // QMap orders by UTF-16, which may differ
+  listing.finish();
+  return listing;
+}
+
+qint64 GirderListing::byteSize() const
+{
+  return m_strings.capacity() + static_cast<qint64>(m_rows.capacity()) * sizeof(Row);
+}
+
+bool GirderListing::operator==(const GirderListing& other) const
+{
+  if (m_rows.size() != other.m_rows.size())
+    return false;
+
+  for (int row = 0; row < m_rows.size(); ++row)
+  {
+    if (keyBytes(row) != other.keyBytes(row) || valueBytes(row) != other.valueBytes(row))
+      return false;
+  }
+  return true;
+}
+
+} // end namespace
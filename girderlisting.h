@@ -0,0 +1,100 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderlisting.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderlisting_h
+#define girderfilebrowser_girderlisting_h
+
+#include <QByteArray>
+#include <QMap>
+#include <QString>
+#include <QVector>
+
+namespace cumulus
+{
+
+// A listing of <key => value>, such as girder's <id => name>, kept in two
+// buffers instead of a QString per key and value and a node per row: one
+// holds every key and value in UTF-8, and the other one the rows, which are
+// offsets into the first. Rows are sorted by key like a QMap. Copies share
+// the buffers, and the last copy frees the whole listing at once.
+class GirderListing
+{
+public:
+  GirderListing() = default;
+
+  // Make room for this many more rows, and bytes of keys and values
+  void reserve(int rows, int bytes);
+
+  // Rows may be appended in any order. finish() must be called after the
+  // last one, before the listing is read.
+  void append(const QString& key, const QString& value);
+  // The same, with key and value in UTF-8
+  void append(const QByteArray& key, const QByteArray& value);
+  // Sort the rows by key. Of the rows with the same key, the last one
+  // appended is kept.
+  void finish();
+
+  // Remove the row of key, if any. Its key and value stay in the buffer
+  // until the whole listing is freed.
+  void remove(const QString& key);
+
+  int size() const { return m_rows.size(); }
+  bool isEmpty() const { return m_rows.isEmpty(); }
+  void clear()
+  {
+    m_strings.clear();
+    m_rows.clear();
+  }
+
+  // The key and value of a row
+  QString key(int row) const;
+  QString value(int row) const;
+
+  // The row of key, or -1 if there is none
+  int indexOf(const QString& key) const;
+  bool contains(const QString& key) const { return indexOf(key) >= 0; }
+  QString value(const QString& key) const;
+
+  // The key and value of a row in UTF-8, only valid as long as the listing
+  QByteArray keyBytes(int row) const;
+  QByteArray valueBytes(int row) const;
+
+  QMap<QString, QString> toMap() const;
+  static GirderListing fromMap(const QMap<QString, QString>& map);
+
+  // Bytes taken by the two buffers
+  qint64 byteSize() const;
+
+  bool operator==(const GirderListing& other) const;
+  bool operator!=(const GirderListing& other) const { return !(*this == other); }
+
+private:
+  struct Row
+  {
+    int keyOffset;
+    int keySize;
+    int valueOffset;
+    int valueSize;
+  };
+
+  // Unlike QString, this compares UTF-8, which only orders keys outside of
+  // the basic multilingual plane differently. Girder ids are hex digits.
+  int compare(const Row& row, const QByteArray& key) const;
+
+  QByteArray m_strings;
+  QVector<Row> m_rows;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,96 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderlistingcache.h"
+
+namespace cumulus
+{
+
+void GirderListingCache::insert(const QString& key, const GirderFuture<GirderListing>& future)
+{
+  removeExpired();
+
+  Entry& entry = m_entries[key];
+  entry.future = future;
+  entry.age.invalidate();
+
+  // Start aging once the listing arrives. The entry is looked up again
+  // since it may have been replaced or taken by then. The cache must
+  // outlive the requests behind its futures.
+  future.subscribe(
+    [this, key](const GirderListing&) {
+      auto it = m_entries.find(key);
+      if (it != m_entries.end() && it->future.isFinished() && !it->age.isValid())
+        it->age.start();
+    },
+    [this, key](const QString&) {
+      auto it = m_entries.find(key);
+      if (it != m_entries.end() && it->future.isFailed())
+        m_entries.erase(it);
+    });
+}
+
+GirderFuture<GirderListing> GirderListingCache::take(const QString& key)
+{
+  auto it = m_entries.find(key);
+  if (it == m_entries.end())
+    return GirderFuture<GirderListing>();
+
+  Entry entry = *it;
+  m_entries.erase(it);
+
+  if (entry.future.isFailed() || (entry.age.isValid() && entry.age.elapsed() > m_maxAge))
+    return GirderFuture<GirderListing>();
+
+  return entry.future;
+}
+
+bool GirderListingCache::contains(const QString& key) const
+{
+  auto it = m_entries.constFind(key);
+  if (it == m_entries.cend() || it->future.isFailed())
+    return false;
+
+  return !it->age.isValid() || it->age.elapsed() <= m_maxAge;
+}
+
+bool GirderListingCache::isPending(const QString& key) const
+{
+  auto it = m_entries.constFind(key);
+  return it != m_entries.cend() && !it->future.isFinished();
+}
+
+void GirderListingCache::removeExpired()
+{
+  for (auto it = m_entries.begin(); it != m_entries.end();)
+  {
+    if (it->age.isValid() && it->age.elapsed() > m_maxAge)
+      it = m_entries.erase(it);
+    else
+      ++it;
+  }
+}
+
+QString GirderListingCache::foldersKey(const QString& parentType, const QString& parentId)
+{
+  return QString("folders:%1:%2").arg(parentType).arg(parentId);
+}
+
+QString GirderListingCache::itemsKey(const QString& folderId)
+{
+  return QString("items:%1").arg(folderId);
+}
+
+QString GirderListingCache::filesKey(const QString& itemId)
+{
+  return QString("files:%1").arg(itemId);
+}
+
+} // end namespace
@@ -0,0 +1,79 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderlistingcache.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderlistingcache_h
+#define girderfilebrowser_girderlistingcache_h
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QString>
+
+#include "girderfuture.h"
+#include "girderlisting.h"
+
+namespace cumulus
+{
+
+// Listings that were requested before anybody asked for them, keyed by
+// what they list. An entry may still be in flight, so that whoever needs
+// it can wait for the request that is already out instead of sending
+// another one. Each entry is handed out once. Entries are kept as
+// GirderListings, so that dropping one frees it at once.
+class GirderListingCache
+{
+public:
+  // Every listing request of girder returns a listing of <id => name>
+  using Listing = GirderListing;
+
+  // Listings that finished more than this long ago are dropped, in msecs
+  void setMaxAge(qint64 msecs) { m_maxAge = msecs; }
+  qint64 maxAge() const { return m_maxAge; }
+
+  // Entries that are too old are dropped along the way
+  void insert(const QString& key, const GirderFuture<GirderListing>& future);
+
+  // Remove and return the entry for key. The future is invalid if there is
+  // no entry, or if it failed or is too old.
+  GirderFuture<GirderListing> take(const QString& key);
+
+  // Whether take() would return a valid future for key
+  bool contains(const QString& key) const;
+  // Whether the entry for key is still in flight
+  bool isPending(const QString& key) const;
+  void remove(const QString& key) { m_entries.remove(key); }
+  void clear() { m_entries.clear(); }
+
+  // The keys of the different listings
+  static QString foldersKey(const QString& parentType, const QString& parentId);
+  static QString itemsKey(const QString& folderId);
+  static QString filesKey(const QString& itemId);
+  static QString myUserKey() { return "me"; }
+  static QString usersKey() { return "users"; }
+  static QString collectionsKey() { return "collections"; }
+
+private:
+  void removeExpired();
+
+  struct Entry
+  {
+    GirderFuture<GirderListing> future;
+    QElapsedTimer age;
+  };
+
+  QHash<QString, Entry> m_entries;
+  qint64 m_maxAge = 60 * 1000;
+};
+
+} // end namespace
+
+#endif
@@ -0,0 +1,642 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderlistingstore.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtConcurrentRun>
+#include <QtEndian>
+
+#include <algorithm>
+#include <limits>
+
+namespace cumulus
+{
+
+static const quint32 storeFileMagic = 0x4c424647; // "GFBL"
+// Bump this if the file layout changes. Older files are then replaced.
+static const quint32 storeFileVersion = 3;
+
+static const int headerSize = 24;
+// Where the committed size is in the header. It is 8 byte aligned, so
+// that readers never see half of it.
+static const int committedOffset = 16;
+
+// Compaction keeps the newest listings up to this many
+static const int maxRecords = 5000;
+// Compact once replaced records take more than this, and more than the
+// live ones
+static const qint64 minReplacedBytes = 1024 * 1024;
+
+// How long the last save waits for another writer, in msecs. Other saves
+// do not wait, and are tried again after saveRetryInterval.
+static const int lockTimeout = 5000;
+static const int saveRetryInterval = 1000;
+
+// Girder ids are 24 hex digits
+static const int idSize = 12;
+
+template<typename T>
+static void append(QByteArray& data, T value)
+{
+  uchar bytes[sizeof(T)];
+  qToLittleEndian<T>(value, bytes);
+  data.append(reinterpret_cast<const char*>(bytes), sizeof(T));
+}
+
+// Read a T at offset and move offset past it. Returns false if it does
+// not fit in data.
+template<typename T>
+static bool read(const QByteArray& data, int& offset, T& value)
+{
+  if (offset < 0 || data.size() - offset < static_cast<int>(sizeof(T)))
+    return false;
+
+  value = qFromLittleEndian<T>(reinterpret_cast<const uchar*>(data.constData() + offset));
+  offset += sizeof(T);
+  return true;
+}
+
+// Set the time a record was stored at, which follows its key
+static void setStoredAt(QByteArray& record, qint64 storedAt)
+{
+  int offset = 0;
+  quint16 keySize = 0;
+  if (read(record, offset, keySize) && record.size() - offset - keySize >= 8)
+    qToLittleEndian<qint64>(storedAt, reinterpret_cast<uchar*>(record.data() + offset + keySize));
+}
+
+static QByteArray header(quint32 generation, quint64 committed)
+{
+  QByteArray data;
+  append<quint32>(data, storeFileMagic);
+  append<quint32>(data, storeFileVersion);
+  append<quint32>(data, generation);
+  append<quint32>(data, 0);
+  append<quint64>(data, committed);
+  return data;
+}
+
+// Returns false if data does not start with a header of this version
+static bool readHeader(const QByteArray& data, quint32& generation, quint64& committed)
+{
+  int offset = 0;
+  quint32 magic = 0, version = 0, unused = 0;
+  generation = 0;
+  bool valid = read(data, offset, magic) && read(data, offset, version) &&
+    read(data, offset, generation) && read(data, offset, unused) &&
+    read(data, offset, committed);
+  return valid && magic == storeFileMagic && version == storeFileVersion &&
+    committed >= static_cast<quint64>(headerSize);
+}
+
+GirderListingStore::GirderListingStore()
+{
+  m_saveRetryTimer.setSingleShot(true);
+  QObject::connect(&m_saveRetryTimer, &QTimer::timeout, [this]() { save(); });
+  QObject::connect(
+    &m_writer, &QFutureWatcher<bool>::finished, [this]() { finishSaving(m_writer.result()); });
+}
+
+GirderListingStore::~GirderListingStore()
+{
+  flush();
+  unmap();
+}
+
+void GirderListingStore::setApiUrl(const QString& apiUrl)
+{
+  if (apiUrl == m_apiUrl)
+    return;
+
+  flush();
+  m_apiUrl = apiUrl;
+  m_pending.clear();
+  load();
+}
+
+QString GirderListingStore::fileName() const
+{
+  QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+  QByteArray hash = QCryptographicHash::hash(m_apiUrl.toUtf8(), QCryptographicHash::Sha1);
+  return dir + "/girderfilebrowser/listings-" + QString::fromLatin1(hash.toHex()) + ".dat";
+}
+
+void GirderListingStore::unmap()
+{
+  if (m_map)
+    m_file.unmap(m_map);
+  m_map = nullptr;
+  m_mapSize = 0;
+  m_file.close();
+}
+
+void GirderListingStore::load()
+{
+  unmap();
+  m_records.clear();
+  m_replacedBytes = 0;
+  m_generation = 0;
+  m_indexedSize = 0;
+  m_loadMsecs = 0;
+  m_lastRefresh.start();
+  if (m_apiUrl.isEmpty())
+    return;
+
+  QElapsedTimer timer;
+  timer.start();
+
+  m_file.setFileName(fileName());
+  if (!m_file.open(QIODevice::ReadOnly))
+    return;
+
+  m_mapSize = m_file.size();
+  m_map = m_mapSize >= headerSize ? m_file.map(0, m_mapSize) : nullptr;
+  if (!m_map)
+  {
+    unmap();
+    return;
+  }
+
+  quint64 committed = 0;
+  QByteArray view = QByteArray::fromRawData(reinterpret_cast<const char*>(m_map), headerSize);
+  if (!readHeader(view, m_generation, committed))
+  {
+    unmap();
+    return;
+  }
+
+  // Only the headers of the records are read. The listings are decoded
+  // on demand.
+  index(headerSize, qMin<qint64>(committed, m_mapSize));
+  m_loadMsecs = timer.elapsed();
+}
+
+void GirderListingStore::index(qint64 from, qint64 to)
+{
+  const char* map = reinterpret_cast<const char*>(m_map);
+  qint64 offset = from;
+  while (offset < to)
+  {
+    // A QByteArray cannot see past 2 GiB, but the file may go further.
+    // Each record is read through its own view instead.
+    int viewSize = static_cast<int>(qMin<qint64>(to - offset, std::numeric_limits<int>::max()));
+    QByteArray view = QByteArray::fromRawData(map + offset, viewSize);
+
+    Record record;
+    QString key;
+    int size = recordSize(view, 0, key, record.storedAt);
+    if (size == 0)
+    {
+      qDebug() << "Ignoring the rest of corrupt listing store" << m_file.fileName();
+      break;
+    }
+
+    record.offset = offset;
+    record.size = size;
+    offset += size;
+
+    auto it = m_records.find(key);
+    if (it != m_records.end())
+    {
+      m_replacedBytes += it->size;
+      m_records.erase(it);
+    }
+
+    // A record stored at 0 marks a removal
+    if (record.storedAt == 0)
+      m_replacedBytes += size;
+    else
+      m_records.insert(key, record);
+  }
+
+  m_indexedSize = offset;
+}
+
+void GirderListingStore::refresh(bool force)
+{
+  if (m_apiUrl.isEmpty() || (!force && m_lastRefresh.isValid() && m_lastRefresh.elapsed() < 1000))
+    return;
+
+  m_lastRefresh.start();
+
+  // The header is read through its own handle, since the file may have
+  // been replaced by a compaction
+  QFile file(fileName());
+  quint32 generation = 0;
+  quint64 committed = 0;
+  if (!file.open(QIODevice::ReadOnly) || !readHeader(file.read(headerSize), generation, committed))
+    return;
+
+  if (generation != m_generation || !m_map)
+  {
+    load();
+    return;
+  }
+
+  if (static_cast<qint64>(committed) <= m_indexedSize)
+    return;
+
+  // The records are kept by offset, so the file can be mapped again
+  if (static_cast<qint64>(committed) > m_mapSize)
+  {
+    m_file.unmap(m_map);
+    m_mapSize = m_file.size();
+    m_map = m_file.map(0, m_mapSize);
+    if (!m_map)
+    {
+      load();
+      return;
+    }
+  }
+
+  index(m_indexedSize, qMin<qint64>(committed, m_mapSize));
+}
+
+void GirderListingStore::save()
+{
+  // Listings are saved one batch at a time
+  if (m_pending.isEmpty() || m_apiUrl.isEmpty() || !m_saving.isEmpty())
+    return;
+
+  QList<QByteArray> records;
+  for (const auto& record : m_pending)
+    records.append(record.data);
+
+  // Found here until they are indexed
+  m_saving = m_pending;
+  m_pending.clear();
+  m_saveRetryTimer.stop();
+  m_writer.setFuture(QtConcurrent::run(&GirderListingStore::write, m_apiUrl, records, 0));
+}
+
+void GirderListingStore::finishSaving(bool written)
+{
+  // Finished by flush() already
+  if (m_saving.isEmpty())
+    return;
+
+  if (!written)
+  {
+    // What was inserted since is newer
+    for (auto it = m_saving.cbegin(); it != m_saving.cend(); ++it)
+    {
+      if (!m_pending.contains(it.key()))
+        m_pending.insert(it.key(), it.value());
+    }
+    m_saving.clear();
+    m_saveRetryTimer.start(saveRetryInterval);
+    return;
+  }
+
+  m_saving.clear();
+  refresh(true);
+
+  // Listings inserted in the meantime
+  if (!m_pending.isEmpty())
+    m_saveRetryTimer.start(0);
+}
+
+void GirderListingStore::flush()
+{
+  if (!m_saving.isEmpty())
+  {
+    m_writer.waitForFinished();
+    finishSaving(m_writer.result());
+  }
+  m_saveRetryTimer.stop();
+
+  if (m_pending.isEmpty() || m_apiUrl.isEmpty())
+    return;
+
+  QList<QByteArray> records;
+  for (const auto& record : m_pending)
+    records.append(record.data);
+
+  if (write(m_apiUrl, records, lockTimeout))
+    m_pending.clear();
+  else
+    qDebug() << "Listing store is locked, not saving" << fileName();
+}
+
+bool GirderListingStore::write(const QString& apiUrl,
+  const QList<QByteArray>& records,
+  int lockWait)
+{
+  GirderListingStore store;
+  store.m_apiUrl = apiUrl;
+  QString name = store.fileName();
+  QDir().mkpath(QFileInfo(name).absolutePath());
+
+  // Only writers lock. Readers keep going on what was committed.
+  QLockFile lock(name + ".lock");
+  if (!lock.tryLock(lockWait) || !store.append(records))
+    return false;
+
+  store.load();
+
+  qint64 liveBytes = 0;
+  for (const auto& record : store.m_records)
+    liveBytes += record.size;
+
+  if ((store.m_replacedBytes < minReplacedBytes || store.m_replacedBytes < liveBytes) &&
+      store.m_records.size() <= maxRecords)
+  {
+    return true;
+  }
+
+  // Compact, keeping the newest listings
+  QList<Record> kept = store.m_records.values();
+  std::sort(kept.begin(), kept.end(),
+    [](const Record& a, const Record& b) { return a.storedAt > b.storedAt; });
+  while (kept.size() > maxRecords)
+    kept.removeLast();
+
+  QList<QByteArray> compacted;
+  for (const auto& record : kept)
+    compacted.append(store.recordData(record));
+
+  // The appended records are in the file already either way
+  store.rewrite(store.m_generation + 1, compacted);
+  return true;
+}
+
+bool GirderListingStore::append(const QList<QByteArray>& records)
+{
+  QFile file(fileName());
+  quint32 generation = 0;
+  quint64 committed = 0;
+  if (!file.open(QIODevice::ReadWrite) || !readHeader(file.read(headerSize), generation, committed) ||
+      static_cast<qint64>(committed) > file.size())
+  {
+    // A new file, an older layout, or a corrupt one. It is replaced rather
+    // than truncated, since other processes may have it mapped.
+    file.close();
+    return rewrite(generation + 1, records);
+  }
+
+  // Anything past the committed size is left over from a writer that did
+  // not finish, and is overwritten
+  file.seek(committed);
+  for (const auto& record : records)
+    committed += file.write(record);
+  if (!file.flush())
+    return false;
+
+  // Now that the records are complete, let the readers see them
+  QByteArray size;
+  append<quint64>(size, committed);
+  file.seek(committedOffset);
+  file.write(size);
+  return file.flush();
+}
+
+bool GirderListingStore::rewrite(quint32 generation, const QList<QByteArray>& records)
+{
+  // Write to a temporary file first, and move it over the old one once
+  // complete. Processes that mapped the old one keep reading it until they
+  // notice the new generation.
+  QSaveFile file(fileName());
+  if (!file.open(QIODevice::WriteOnly))
+    return false;
+
+  quint64 committed = headerSize;
+  for (const auto& record : records)
+    committed += record.size();
+
+  file.write(header(generation, committed));
+  for (const auto& record : records)
+    file.write(record);
+
+  return file.commit();
+}
+
+int GirderListingStore::recordSize(const QByteArray& data,
+  int offset,
+  QString& key,
+  qint64& storedAt)
+{
+  int start = offset;
+  quint16 keySize = 0;
+  if (!read(data, offset, keySize) || data.size() - offset < keySize)
+    return 0;
+
+  key = QString::fromUtf8(data.constData() + offset, keySize);
+  offset += keySize;
+
+  quint16 markSize = 0;
+  quint32 entryCount = 0, namesSize = 0;
+  if (!read(data, offset, storedAt) || !read(data, offset, markSize) ||
+      data.size() - offset < markSize)
+  {
+    return 0;
+  }
+
+  offset += markSize;
+  if (!read(data, offset, entryCount) || !read(data, offset, namesSize))
+    return 0;
+
+  qint64 payload = static_cast<qint64>(entryCount) * idSize + namesSize;
+  if (data.size() - offset < payload)
+    return 0;
+
+  return offset + static_cast<int>(payload) - start;
+}
+
+bool GirderListingStore::encode(const QString& key,
+  qint64 storedAt,
+  const QString& highWaterMark,
+  const GirderListing& listing,
+  QByteArray& data)
+{
+  QByteArray ids;
+  QByteArray names;
+  ids.reserve(listing.size() * idSize);
+  for (int row = 0; row < listing.size(); ++row)
+  {
+    QByteArray hex = listing.keyBytes(row);
+    QByteArray id = QByteArray::fromHex(hex);
+    QByteArray name = listing.valueBytes(row);
+    // The id has to come back the same from the hex digits
+    if (id.size() != idSize || id.toHex() != hex ||
+        name.size() > std::numeric_limits<quint16>::max())
+    {
+      return false;
+    }
+
+    ids.append(id);
+    append<quint16>(names, name.size());
+    names.append(name);
+  }
+
+  QByteArray keyBytes = key.toUtf8();
+  QByteArray markBytes = highWaterMark.toLatin1();
+  data.clear();
+  append<quint16>(data, keyBytes.size());
+  data.append(keyBytes);
+  append<qint64>(data, storedAt);
+  append<quint16>(data, markBytes.size());
+  data.append(markBytes);
+  append<quint32>(data, listing.size());
+  append<quint32>(data, names.size());
+  data.append(ids);
+  data.append(names);
+  return true;
+}
+
+bool GirderListingStore::decode(const QByteArray& data,
+  GirderListing& listing,
+  QString& highWaterMark)
+{
+  int offset = 0;
+  quint16 keySize = 0, markSize = 0;
+  qint64 storedAt = 0;
+  quint32 entryCount = 0, namesSize = 0;
+  if (!read(data, offset, keySize))
+    return false;
+
+  offset += keySize;
+  if (!read(data, offset, storedAt) || !read(data, offset, markSize) ||
+      data.size() - offset < markSize)
+  {
+    return false;
+  }
+
+  highWaterMark = QString::fromLatin1(data.constData() + offset, markSize);
+  offset += markSize;
+  if (!read(data, offset, entryCount) || !read(data, offset, namesSize))
+    return false;
+
+  int idsOffset = offset;
+  int namesOffset = offset + static_cast<int>(entryCount) * idSize;
+
+  listing = GirderListing();
+  listing.reserve(entryCount, entryCount * idSize * 2 + namesSize);
+  for (quint32 i = 0; i < entryCount; ++i)
+  {
+    quint16 nameSize = 0;
+    if (!read(data, namesOffset, nameSize) || data.size() - namesOffset < nameSize)
+      return false;
+
+    QByteArray id = QByteArray::fromRawData(data.constData() + idsOffset, idSize);
+    listing.append(id.toHex(), QByteArray::fromRawData(data.constData() + namesOffset, nameSize));
+    idsOffset += idSize;
+    namesOffset += nameSize;
+  }
+
+  // Records are written in order already
+  listing.finish();
+  return true;
+}
+
+QByteArray GirderListingStore::recordData(const Record& record) const
+{
+  if (!record.data.isEmpty())
+    return record.data;
+
+  // Only valid until the file is mapped again
+  return QByteArray::fromRawData(reinterpret_cast<const char*>(m_map) + record.offset, record.size);
+}
+
+const GirderListingStore::Record* GirderListingStore::record(const QString& key)
+{
+  auto pending = m_pending.constFind(key);
+  if (pending != m_pending.cend())
+    return &pending.value();
+
+  auto saving = m_saving.constFind(key);
+  if (saving != m_saving.cend())
+    return &saving.value();
+
+  auto it = m_records.constFind(key);
+  if (it == m_records.cend() || QDateTime::currentMSecsSinceEpoch() - it->storedAt > m_maxAge)
+  {
+    // Another process may have stored it since
+    refresh();
+    it = m_records.constFind(key);
+  }
+
+  return it == m_records.cend() ? nullptr : &it.value();
+}
+
+void GirderListingStore::insert(const QString& key,
+  const Listing& listing,
+  const QString& highWaterMark)
+{
+  Listing stored;
+  QString storedMark;
+  const Record* existing = record(key);
+  Record record;
+  record.storedAt = QDateTime::currentMSecsSinceEpoch();
+  if (existing && existing->storedAt > 0 && decode(recordData(*existing), stored, storedMark) &&
+      stored == listing && (highWaterMark.isEmpty() || highWaterMark == storedMark))
+  {
+    // The listing was just confirmed, so only its age changes. The copy
+    // of the record keeps its high-water mark.
+    record.data = recordData(*existing);
+    setStoredAt(record.data, record.storedAt);
+    m_pending.insert(key, record);
+    return;
+  }
+
+  if (!encode(key, record.storedAt, highWaterMark, listing, record.data))
+  {
+    remove(key);
+    return;
+  }
+
+  m_pending.insert(key, record);
+}
+
+bool GirderListingStore::find(const QString& key, Listing& listing)
+{
+  QString highWaterMark;
+  return contains(key) && decode(recordData(*record(key)), listing, highWaterMark);
+}
+
+bool GirderListingStore::findForRefresh(const QString& key,
+  Listing& listing,
+  QString& highWaterMark)
+{
+  const Record* stored = record(key);
+  return stored && stored->storedAt > 0 && decode(recordData(*stored), listing, highWaterMark);
+}
+
+bool GirderListingStore::contains(const QString& key)
+{
+  const Record* stored = record(key);
+  return stored && stored->storedAt > 0 &&
+    QDateTime::currentMSecsSinceEpoch() - stored->storedAt <= m_maxAge;
+}
+
+qint64 GirderListingStore::age(const QString& key)
+{
+  const Record* stored = record(key);
+  if (!stored || stored->storedAt == 0)
+    return -1;
+  return QDateTime::currentMSecsSinceEpoch() - stored->storedAt;
+}
+
+void GirderListingStore::remove(const QString& key)
+{
+  // An empty listing stored at 0 removes the key from the file
+  Record record;
+  encode(key, 0, QString(), GirderListing(), record.data);
+  m_pending.insert(key, record);
+}
+
+} // end namespace
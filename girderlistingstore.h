@@ -0,0 +1,172 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderlistingstore.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderlistingstore_h
+#define girderfilebrowser_girderlistingstore_h
+
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFutureWatcher>
+#include <QHash>
+#include <QString>
+#include <QTimer>
+
+#include "girderlisting.h"
+
+namespace cumulus
+{
+
+// Listings kept on disk between sessions, so that folders visited before
+// can be shown after a restart without asking the server. The listings of
+// each server are kept in a file in the user's cache directory, which is
+// shared by every process of the user.
+//
+// The file is memory mapped and only ever appended to. A record is only
+// decoded when its listing is asked for, and a later record for the same
+// key replaces an earlier one. Readers never lock: they only look at the
+// records below the committed size in the header, which a writer updates
+// after its records are written. Writers append under a QLockFile, on a
+// worker thread. When most of the file is replaced records, a writer
+// compacts it into a new file, which readers pick up on their next
+// refresh.
+//
+// File layout, little endian:
+//   quint32 magic, quint32 version, quint32 generation, quint32 unused,
+//   quint64 committed size, then records of
+//   quint16 key size, key (UTF-8)
+//   qint64  msecs since epoch when the listing was stored, 0 if removed
+//   quint16 high-water mark size, high-water mark (Latin-1)
+//   quint32 entry count, quint32 size of the names
+//   12 bytes per entry: the girder object id
+//   per entry: quint16 name size, name (UTF-8)
+class GirderListingStore
+{
+public:
+  // Every listing request of girder returns a listing of <id => name>
+  using Listing = GirderListing;
+
+  GirderListingStore();
+  // Waits for the listings being saved, and saves the rest
+  ~GirderListingStore();
+
+  // Save the current listings, if any, and load the ones of apiUrl. This
+  // waits for the listings being saved, like the destructor.
+  void setApiUrl(const QString& apiUrl);
+
+  // Append the listings inserted since the last save to the file, on a
+  // worker thread. If another writer has the file locked, or listings are
+  // being saved already, they are saved a little later instead.
+  void save();
+
+  // Listings stored more than this long ago are not used, in msecs
+  void setMaxAge(qint64 msecs) { m_maxAge = msecs; }
+  qint64 maxAge() const { return m_maxAge; }
+
+  // Listings with an id that is not a girder object id are not stored.
+  // highWaterMark is the latest "updated" time of the listed objects, from
+  // which a delta listing can bring the listing up to date later. Storing
+  // the same listing again without one keeps the stored high-water mark,
+  // and only makes the listing new again.
+  void insert(const QString& key, const Listing& listing, const QString& highWaterMark = QString());
+
+  // Whether a listing that is not too old is stored for key, and if so,
+  // set listing to it. These pick up what other processes stored.
+  bool find(const QString& key, Listing& listing);
+  bool contains(const QString& key);
+
+  // The same as find(), whatever the age of the listing, along with its
+  // high-water mark, which may be empty
+  bool findForRefresh(const QString& key, Listing& listing, QString& highWaterMark);
+
+  // Msecs since the listing for key was stored, or -1 if there is none
+  qint64 age(const QString& key);
+
+  void remove(const QString& key);
+
+  int size() const { return m_records.size(); }
+
+  // How long mapping and indexing the file took, in msecs
+  qint64 loadMsecs() const { return m_loadMsecs; }
+
+private:
+  struct Record
+  {
+    qint64 storedAt = 0;
+    // Where the record is in the mapped file
+    qint64 offset = 0;
+    int size = 0;
+    // The encoded record, if it is not written yet
+    QByteArray data;
+  };
+
+  static bool encode(const QString& key,
+    qint64 storedAt,
+    const QString& highWaterMark,
+    const GirderListing& listing,
+    QByteArray& data);
+  static bool decode(const QByteArray& data, GirderListing& listing, QString& highWaterMark);
+  // The size of the record at offset, or 0 if it does not fit in data
+  static int recordSize(const QByteArray& data, int offset, QString& key, qint64& storedAt);
+
+  QString fileName() const;
+  QByteArray recordData(const Record& record) const;
+  const Record* record(const QString& key);
+
+  // Map the file again and index every record in it
+  void load();
+  // Index what other processes appended, at most once a second unless
+  // forced
+  void refresh(bool force = false);
+  void index(qint64 from, qint64 to);
+  void unmap();
+
+  // Append records to the file of apiUrl, and compact it if needed. This
+  // runs on a worker thread, with a store of its own. Returns false if the
+  // file stays locked by another writer for lockWait msecs, or cannot be
+  // written.
+  static bool write(const QString& apiUrl, const QList<QByteArray>& records, int lockWait);
+  // Index the records written by save()
+  void finishSaving(bool written);
+  // Wait for save() to finish, and write what is left on this thread
+  void flush();
+
+  // These must be called with the file locked
+  bool append(const QList<QByteArray>& records);
+  bool rewrite(quint32 generation, const QList<QByteArray>& records);
+
+  QString m_apiUrl;
+  QFile m_file;
+  uchar* m_map = nullptr;
+  qint64 m_mapSize = 0;
+  quint32 m_generation = 0;
+  qint64 m_indexedSize = 0;
+  QElapsedTimer m_lastRefresh;
+
+  // The latest record of every key in the file, those being written, and
+  // those not written yet
+  QHash<QString, Record> m_records;
+  QHash<QString, Record> m_saving;
+  QHash<QString, Record> m_pending;
+  QFutureWatcher<bool> m_writer;
+  QTimer m_saveRetryTimer;
+  // Bytes of the file taken by records that were replaced
+  qint64 m_replacedBytes = 0;
+
+  qint64 m_maxAge = 10 * 60 * 1000;
+  qint64 m_loadMsecs = 0;
+};
+
+} // end namespace
+
+#endif
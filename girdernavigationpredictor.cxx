@@ -0,0 +1,222 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdernavigationpredictor.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QPair>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <algorithm>
+
+namespace cumulus
+{
+
+// Bump this if the file layout changes. Older files are then ignored.
+static const quint32 modelFileVersion = 1;
+
+// Keep the model small: a few destinations per folder, and a bounded
+// number of folders
+static const int maxTransitionsPerFolder = 16;
+static const int maxFolders = 2000;
+
+// Once the transitions of a folder add up to this, they are halved, so
+// that recent habits outweigh old ones
+static const double maxTransitionCount = 64;
+
+GirderNavigationPredictor::~GirderNavigationPredictor()
+{
+  save();
+}
+
+QString GirderNavigationPredictor::key(const QMap<QString, QString>& folder)
+{
+  return folder.value("type") + ":" + folder.value("id");
+}
+
+void GirderNavigationPredictor::setApiUrl(const QString& apiUrl)
+{
+  if (apiUrl == m_apiUrl)
+    return;
+
+  save();
+  m_apiUrl = apiUrl;
+  m_transitions.clear();
+  load();
+}
+
+QString GirderNavigationPredictor::fileName() const
+{
+  QString dir = QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation);
+  QByteArray hash = QCryptographicHash::hash(m_apiUrl.toUtf8(), QCryptographicHash::Sha1);
+  return dir + "/girderfilebrowser/navigation-" + QString::fromLatin1(hash.toHex()) + ".dat";
+}
+
+void GirderNavigationPredictor::load()
+{
+  m_modified = false;
+  if (m_apiUrl.isEmpty())
+    return;
+
+  QFile file(fileName());
+  if (!file.open(QIODevice::ReadOnly))
+    return;
+
+  QDataStream stream(&file);
+  quint32 version = 0;
+  stream >> version;
+  if (version != modelFileVersion)
+    return;
+
+  QHash<QString, QList<QPair<QMap<QString, QString>, double> > > transitions;
+  stream >> transitions;
+  if (stream.status() != QDataStream::Ok)
+  {
+    qDebug() << "Ignoring corrupt navigation model" << file.fileName();
+    return;
+  }
+
+  for (auto it = transitions.cbegin(); it != transitions.cend(); ++it)
+  {
+    QList<Transition>& list = m_transitions[it.key()];
+    for (const auto& pair : it.value())
+    {
+      Transition transition;
+      transition.to = pair.first;
+      transition.count = pair.second;
+      list.append(transition);
+    }
+  }
+}
+
+void GirderNavigationPredictor::save()
+{
+  if (!m_modified || m_apiUrl.isEmpty())
+    return;
+
+  QHash<QString, QList<QPair<QMap<QString, QString>, double> > > transitions;
+  for (auto it = m_transitions.cbegin(); it != m_transitions.cend(); ++it)
+  {
+    auto& list = transitions[it.key()];
+    for (const auto& transition : it.value())
+      list.append(qMakePair(transition.to, transition.count));
+  }
+
+  QString name = fileName();
+  QDir().mkpath(QFileInfo(name).absolutePath());
+
+  QSaveFile file(name);
+  if (!file.open(QIODevice::WriteOnly))
+    return;
+
+  QDataStream stream(&file);
+  stream << modelFileVersion << transitions;
+
+  if (file.commit())
+    m_modified = false;
+}
+
+void GirderNavigationPredictor::recordTransition(const QMap<QString, QString>& from,
+  const QMap<QString, QString>& to)
+{
+  if (from.isEmpty() || to.isEmpty() || key(from) == key(to))
+    return;
+
+  if (!m_transitions.contains(key(from)) && m_transitions.size() >= maxFolders)
+  {
+    // Forget the folder we know the least about
+    auto least = m_transitions.begin();
+    double leastTotal = -1;
+    for (auto it = m_transitions.begin(); it != m_transitions.end(); ++it)
+    {
+      double total = 0;
+      for (const auto& transition : it.value())
+        total += transition.count;
+      if (leastTotal < 0 || total < leastTotal)
+      {
+        least = it;
+        leastTotal = total;
+      }
+    }
+    m_transitions.erase(least);
+  }
+
+  QList<Transition>& transitions = m_transitions[key(from)];
+
+  double total = 0;
+  bool found = false;
+  for (auto& transition : transitions)
+  {
+    if (key(transition.to) == key(to))
+    {
+      // The name may have changed
+      transition.to = to;
+      transition.count += 1;
+      found = true;
+    }
+    total += transition.count;
+  }
+
+  if (!found)
+  {
+    Transition transition;
+    transition.to = to;
+    transition.count = 1;
+    transitions.append(transition);
+    total += 1;
+  }
+
+  if (total > maxTransitionCount)
+  {
+    for (auto& transition : transitions)
+      transition.count /= 2;
+  }
+
+  std::sort(transitions.begin(), transitions.end(),
+    [](const Transition& a, const Transition& b) { return a.count > b.count; });
+  while (transitions.size() > maxTransitionsPerFolder)
+    transitions.removeLast();
+
+  m_modified = true;
+}
+
+QList<QMap<QString, QString> > GirderNavigationPredictor::predict(
+  const QMap<QString, QString>& from,
+  int count,
+  double minProbability) const
+{
+  QList<QMap<QString, QString> > predictions;
+
+  auto it = m_transitions.constFind(key(from));
+  if (it == m_transitions.cend())
+    return predictions;
+
+  double total = 0;
+  for (const auto& transition : it.value())
+    total += transition.count;
+
+  // The transitions are sorted, most likely first
+  for (const auto& transition : it.value())
+  {
+    if (predictions.size() >= count || transition.count / total < minProbability)
+      break;
+    predictions.append(transition.to);
+  }
+
+  return predictions;
+}
+
+} // end namespace
@@ -0,0 +1,69 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdernavigationpredictor.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdernavigationpredictor_h
+#define girderfilebrowser_girdernavigationpredictor_h
+
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QString>
+
+namespace cumulus
+{
+
+// A first order Markov model of folder changes: for every folder, how
+// often each other folder was opened next. Users tend to follow the same
+// paths, so the most likely next folders are worth prefetching. The model
+// of each server is kept in a file in the user's cache directory.
+class GirderNavigationPredictor
+{
+public:
+  GirderNavigationPredictor() = default;
+  ~GirderNavigationPredictor();
+
+  // Save the current model, if any, and load the one of apiUrl
+  void setApiUrl(const QString& apiUrl);
+
+  // Write the model to its file, if it changed
+  void save();
+
+  // The folders contain "type", "id", and "name"
+  void recordTransition(const QMap<QString, QString>& from, const QMap<QString, QString>& to);
+
+  // Up to count folders most likely to be opened after from, most likely
+  // first. Only folders with at least minProbability are returned.
+  QList<QMap<QString, QString> > predict(const QMap<QString, QString>& from,
+    int count,
+    double minProbability = 0.2) const;
+
+private:
+  struct Transition
+  {
+    QMap<QString, QString> to;
+    double count = 0;
+  };
+
+  static QString key(const QMap<QString, QString>& folder);
+  QString fileName() const;
+  void load();
+
+  QString m_apiUrl;
+  // Transitions by the key of the folder they start from
+  QHash<QString, QList<Transition> > m_transitions;
+  bool m_modified = false;
+};
+
+} // end namespace
+
+#endif
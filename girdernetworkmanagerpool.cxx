@@ -0,0 +1,121 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdernetworkmanagerpool.h"
+
+#include <QNetworkAccessManager>
+#include <QNetworkCookieJar>
+#include <QNetworkProxy>
+#include <QPointer>
+
+#include <algorithm>
+
+namespace cumulus
+{
+
+// A manager takes ownership of its proxy factory, so the managers of the
+// pool each get one of these, which asks the factory of the prototype
+class PrototypeProxyFactory : public QNetworkProxyFactory
+{
+public:
+  explicit PrototypeProxyFactory(QNetworkAccessManager* prototype)
+    : m_prototype(prototype)
+  {
+  }
+
+  QList<QNetworkProxy> queryProxy(const QNetworkProxyQuery& query) override
+  {
+    if (!m_prototype || !m_prototype->proxyFactory())
+      return QList<QNetworkProxy>{ QNetworkProxy(QNetworkProxy::NoProxy) };
+    return m_prototype->proxyFactory()->queryProxy(query);
+  }
+
+private:
+  QPointer<QNetworkAccessManager> m_prototype;
+};
+
+GirderNetworkManagerPool::GirderNetworkManagerPool(int size,
+  QNetworkAccessManager* prototype,
+  QObject* parent)
+  : QObject(parent)
+  , m_loads(std::max(size, 1), 0)
+{
+  for (int i = 0; i < m_loads.size(); ++i)
+  {
+    std::unique_ptr<QNetworkAccessManager> manager(new QNetworkAccessManager);
+    if (prototype)
+      copyPrototype(prototype, manager.get());
+    m_managers.push_back(std::move(manager));
+  }
+}
+
+GirderNetworkManagerPool::~GirderNetworkManagerPool() = default;
+
+void GirderNetworkManagerPool::copyPrototype(QNetworkAccessManager* prototype,
+  QNetworkAccessManager* manager)
+{
+  if (prototype->proxyFactory())
+    manager->setProxyFactory(new PrototypeProxyFactory(prototype));
+  else
+    manager->setProxy(prototype->proxy());
+  manager->setConfiguration(prototype->configuration());
+#if QT_VERSION >= QT_VERSION_CHECK(5, 9, 0)
+  manager->setRedirectPolicy(prototype->redirectPolicy());
+  manager->setStrictTransportSecurityEnabled(prototype->isStrictTransportSecurityEnabled());
+#endif
+
+  // The cookie jar is shared. Setting it makes the manager its parent, so
+  // it is given back to the prototype.
+  QNetworkCookieJar* cookieJar = prototype->cookieJar();
+  QObject* cookieJarParent = cookieJar->parent();
+  manager->setCookieJar(cookieJar);
+  cookieJar->setParent(cookieJarParent);
+
+  // The handlers of the embedding application are connected to the
+  // prototype, so its signals are emitted for the replies of the pool
+  connect(manager, &QNetworkAccessManager::authenticationRequired, prototype,
+    &QNetworkAccessManager::authenticationRequired);
+  connect(manager, &QNetworkAccessManager::proxyAuthenticationRequired, prototype,
+    &QNetworkAccessManager::proxyAuthenticationRequired);
+#ifndef QT_NO_SSL
+  connect(manager, &QNetworkAccessManager::sslErrors, prototype,
+    &QNetworkAccessManager::sslErrors);
+#endif
+}
+
+QList<QNetworkAccessManager*> GirderNetworkManagerPool::managers() const
+{
+  QList<QNetworkAccessManager*> list;
+  for (const auto& manager : m_managers)
+    list.append(manager.get());
+  return list;
+}
+
+QNetworkAccessManager* GirderNetworkManagerPool::acquire()
+{
+  int index = static_cast<int>(
+    std::min_element(m_loads.cbegin(), m_loads.cend()) - m_loads.cbegin());
+  ++m_loads[index];
+  return m_managers[index].get();
+}
+
+void GirderNetworkManagerPool::release(QNetworkAccessManager* manager)
+{
+  for (size_t i = 0; i < m_managers.size(); ++i)
+  {
+    if (m_managers[i].get() == manager)
+    {
+      m_loads[static_cast<int>(i)] = std::max(m_loads[static_cast<int>(i)] - 1, 0);
+      return;
+    }
+  }
+}
+
+} // end namespace
@@ -0,0 +1,74 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdernetworkmanagerpool.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdernetworkmanagerpool_h
+#define girderfilebrowser_girdernetworkmanagerpool_h
+
+#include <QList>
+#include <QObject>
+#include <QVector>
+
+#include <memory>
+#include <vector>
+
+class QNetworkAccessManager;
+
+namespace cumulus
+{
+
+// QNetworkAccessManager opens at most six connections per host, so that is
+// the most parallel requests one manager can have in flight against the
+// girder server. This pool spreads requests over several managers, each
+// with its own connections, and always hands out the least loaded one.
+//
+// The managers live in the thread that created the pool. A reply has the
+// thread affinity of its manager, and the requests read their replies in
+// the gui thread, so the managers cannot be moved to worker threads. They
+// do not need to be either, since managers never block.
+class GirderNetworkManagerPool : public QObject
+{
+  Q_OBJECT
+
+public:
+  // If prototype is set, every manager uses its proxy or proxy factory,
+  // its configuration and its cookie jar, and emits its
+  // authenticationRequired(), proxyAuthenticationRequired() and
+  // sslErrors() signals, so that the handlers connected to it see the
+  // replies of the pool. Its cache is not shared, since a cache belongs
+  // to a single manager. The prototype should outlive the pool.
+  explicit GirderNetworkManagerPool(int size,
+    QNetworkAccessManager* prototype = nullptr,
+    QObject* parent = nullptr);
+  virtual ~GirderNetworkManagerPool() override;
+
+  int size() const { return static_cast<int>(m_managers.size()); }
+  QList<QNetworkAccessManager*> managers() const;
+
+  // The manager with the fewest requests in flight. Every call must be
+  // followed by exactly one call to release() once the reply finishes.
+  QNetworkAccessManager* acquire();
+  void release(QNetworkAccessManager* manager);
+
+  // Number of requests in flight for every manager
+  QVector<int> loads() const { return m_loads; }
+
+private:
+  void copyPrototype(QNetworkAccessManager* prototype, QNetworkAccessManager* manager);
+
+  std::vector<std::unique_ptr<QNetworkAccessManager> > m_managers;
+  QVector<int> m_loads;
+};
+
+} // end namespace
+
+#endif
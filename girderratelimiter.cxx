@@ -0,0 +1,159 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderratelimiter.h"
+
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <algorithm>
+#include <cmath>
+
+namespace cumulus
+{
+
+GirderRateLimiter::GirderRateLimiter(QObject* parent)
+  : QObject(parent)
+{
+  m_clock.start();
+}
+
+GirderRateLimiter* GirderRateLimiter::instance()
+{
+  // Parent it to the application so that it is deleted with it
+  static GirderRateLimiter* limiter = new GirderRateLimiter(QCoreApplication::instance());
+  return limiter;
+}
+
+GirderRateLimiter::Budget& GirderRateLimiter::budget(TrafficClass trafficClass)
+{
+  return m_budgets[static_cast<int>(trafficClass)];
+}
+
+const GirderRateLimiter::Budget& GirderRateLimiter::budget(TrafficClass trafficClass) const
+{
+  return m_budgets[static_cast<int>(trafficClass)];
+}
+
+void GirderRateLimiter::setRate(Bucket& bucket, double rate, double burst)
+{
+  bucket.rate = std::max(rate, 0.0);
+  bucket.capacity = burst > 0 ? burst : std::max(bucket.rate, 1.0);
+  bucket.tokens = bucket.capacity;
+  bucket.lastRefill = m_clock.elapsed();
+}
+
+void GirderRateLimiter::setRequestRate(TrafficClass trafficClass,
+  double requestsPerSecond,
+  double burst)
+{
+  setRate(budget(trafficClass).requests, requestsPerSecond, burst);
+  drain(trafficClass);
+}
+
+double GirderRateLimiter::requestRate(TrafficClass trafficClass) const
+{
+  return budget(trafficClass).requests.rate;
+}
+
+void GirderRateLimiter::setByteRate(TrafficClass trafficClass, double bytesPerSecond, double burst)
+{
+  setRate(budget(trafficClass).bytes, bytesPerSecond, burst);
+  drain(trafficClass);
+}
+
+double GirderRateLimiter::byteRate(TrafficClass trafficClass) const
+{
+  return budget(trafficClass).bytes.rate;
+}
+
+void GirderRateLimiter::refill(Bucket& bucket)
+{
+  qint64 now = m_clock.elapsed();
+  bucket.tokens =
+    std::min(bucket.tokens + bucket.rate * (now - bucket.lastRefill) / 1000.0, bucket.capacity);
+  bucket.lastRefill = now;
+}
+
+qint64 GirderRateLimiter::waitTime(Budget& budget)
+{
+  double wait = 0;
+
+  if (budget.requests.rate > 0)
+  {
+    refill(budget.requests);
+    if (budget.requests.tokens < 1.0)
+      wait = std::max(wait, (1.0 - budget.requests.tokens) / budget.requests.rate);
+  }
+
+  if (budget.bytes.rate > 0)
+  {
+    refill(budget.bytes);
+    if (budget.bytes.tokens < 0)
+      wait = std::max(wait, -budget.bytes.tokens / budget.bytes.rate);
+  }
+
+  return static_cast<qint64>(std::ceil(wait * 1000.0));
+}
+
+void GirderRateLimiter::acquire(TrafficClass trafficClass,
+  QObject* context,
+  std::function<void()> start)
+{
+  budget(trafficClass).queue.emplace_back(QPointer<QObject>(context), std::move(start));
+  drain(trafficClass);
+}
+
+void GirderRateLimiter::consumeBytes(TrafficClass trafficClass, qint64 bytes)
+{
+  Bucket& bucket = budget(trafficClass).bytes;
+  if (bucket.rate <= 0)
+    return;
+
+  refill(bucket);
+  bucket.tokens -= bytes;
+}
+
+void GirderRateLimiter::drain(TrafficClass trafficClass)
+{
+  Budget& b = budget(trafficClass);
+  if (b.drainScheduled)
+    return;
+
+  while (!b.queue.empty())
+  {
+    // The requester went away while it was waiting
+    if (!b.queue.front().first)
+    {
+      b.queue.pop_front();
+      continue;
+    }
+
+    qint64 wait = waitTime(b);
+    if (wait > 0)
+    {
+      b.drainScheduled = true;
+      QTimer::singleShot(static_cast<int>(wait), this, [this, trafficClass]() {
+        budget(trafficClass).drainScheduled = false;
+        drain(trafficClass);
+      });
+      return;
+    }
+
+    if (b.requests.rate > 0)
+      b.requests.tokens -= 1.0;
+
+    auto start = std::move(b.queue.front().second);
+    b.queue.pop_front();
+    start();
+  }
+}
+
+} // end namespace
@@ -0,0 +1,102 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderratelimiter.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderratelimiter_h
+#define girderfilebrowser_girderratelimiter_h
+
+#include <QElapsedTimer>
+#include <QObject>
+#include <QPair>
+#include <QPointer>
+
+#include <deque>
+#include <functional>
+
+namespace cumulus
+{
+
+// A process-wide set of token buckets shared by every GirderRequest. Each
+// traffic class has its own budget of requests per second and bytes per
+// second, so that bulk downloads cannot starve (or get throttled because
+// of) interactive browsing. A rate of zero means unlimited, which is the
+// default for every class.
+class GirderRateLimiter : public QObject
+{
+  Q_OBJECT
+
+public:
+  enum class TrafficClass {
+    // Requests a user is actively waiting for, such as opening a folder
+    interactive,
+    // Background listings and lookups
+    metadata,
+    // File contents
+    download
+  };
+
+  static GirderRateLimiter* instance();
+
+  // burst is the bucket size: how many requests may be sent at once after
+  // a quiet period. It defaults to one second worth of requests.
+  void setRequestRate(TrafficClass trafficClass, double requestsPerSecond, double burst = 0);
+  double requestRate(TrafficClass trafficClass) const;
+
+  // Bytes are charged after they arrive, so a large reply can put the
+  // bucket in debt. Later requests of that class wait until it recovers.
+  void setByteRate(TrafficClass trafficClass, double bytesPerSecond, double burst = 0);
+  double byteRate(TrafficClass trafficClass) const;
+
+  // Call start as soon as the budget of trafficClass allows another
+  // request. If context is destroyed before then, start is dropped.
+  void acquire(TrafficClass trafficClass, QObject* context, std::function<void()> start);
+
+  // Charge bytes that were received for trafficClass
+  void consumeBytes(TrafficClass trafficClass, qint64 bytes);
+
+private:
+  explicit GirderRateLimiter(QObject* parent = nullptr);
+
+  struct Bucket
+  {
+    double rate = 0;
+    double capacity = 0;
+    double tokens = 0;
+    qint64 lastRefill = 0;
+  };
+
+  struct Budget
+  {
+    Bucket requests;
+    Bucket bytes;
+    std::deque<QPair<QPointer<QObject>, std::function<void()> > > queue;
+    bool drainScheduled = false;
+  };
+
+  Budget& budget(TrafficClass trafficClass);
+  const Budget& budget(TrafficClass trafficClass) const;
+
+  void setRate(Bucket& bucket, double rate, double burst);
+  void refill(Bucket& bucket);
+
+  // How long until the budget allows another request, in msecs
+  qint64 waitTime(Budget& budget);
+
+  void drain(TrafficClass trafficClass);
+
+  QElapsedTimer m_clock;
+  Budget m_budgets[3];
+};
+
+} // end namespace
+
+#endif
@@ -11,20 +11,25 @@
 #include "girderrequest.h"
 #include "utils.h"
 
+#include <QDateTime>
 #include <QDebug>
 #include <QJsonArray>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <QMetaMethod>
 #include <QPair>
 #include <QtCore/QDir>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QFile>
 #include <QtCore/QList>
 #include <QtCore/QMap>
+#include <QtCore/QTimer>
 #include <QtCore/QUrlQuery>
 #include <QtNetwork/QNetworkAccessManager>
 #include <QtNetwork/QNetworkCookieJar>
 #include <QtNetwork/QNetworkReply>
 #include <QtNetwork/QNetworkRequest>
+#include <QtNetwork/QSslConfiguration>
 
 #include <memory>
 
@@ -40,7 +45,207 @@ GirderRequest::GirderRequest(QNetworkAccessManager* networkManager,
   , m_networkManager(networkManager)
 {}
 
-GirderRequest::~GirderRequest() {}
+GirderRequest::~GirderRequest()
+{
+  // Nobody is waiting for the reply anymore
+  if (m_activeReply) {
+    m_activeReply->disconnect(this);
+    m_activeReply->abort();
+    m_activeReply->deleteLater();
+  }
+}
+
+static QPointer<GirderNetworkManagerPool>& sharedNetworkManagerPool()
+{
+  static QPointer<GirderNetworkManagerPool> pool;
+  return pool;
+}
+
+void GirderRequest::setNetworkManagerPool(GirderNetworkManagerPool* pool)
+{
+  sharedNetworkManagerPool() = pool;
+}
+
+GirderNetworkManagerPool* GirderRequest::networkManagerPool()
+{
+  return sharedNetworkManagerPool();
+}
+
+static GirderRequest::TransportProfile& sharedTransportProfile()
+{
+  static GirderRequest::TransportProfile profile =
+    GirderRequest::TransportProfile::http1;
+  return profile;
+}
+
+void GirderRequest::setTransportProfile(TransportProfile profile)
+{
+  sharedTransportProfile() = profile;
+}
+
+GirderRequest::TransportProfile GirderRequest::transportProfile()
+{
+  return sharedTransportProfile();
+}
+
+struct TlsSession
+{
+  QString apiUrl;
+  QByteArray ticket;
+};
+
+static TlsSession& sharedTlsSession()
+{
+  static TlsSession session;
+  return session;
+}
+
+void GirderRequest::setTlsSession(const QString& apiUrl, const QByteArray& ticket)
+{
+  sharedTlsSession().apiUrl = apiUrl;
+  sharedTlsSession().ticket = ticket;
+}
+
+#ifndef QT_NO_SSL
+QSslConfiguration GirderRequest::sslConfiguration(const QUrl& url)
+{
+  QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+  const TlsSession& session = sharedTlsSession();
+  QUrl sessionUrl(session.apiUrl);
+  if (session.apiUrl.isEmpty() || url.scheme() != sessionUrl.scheme() ||
+      url.host() != sessionUrl.host() || url.port() != sessionUrl.port()) {
+    return configuration;
+  }
+
+  configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+  if (!session.ticket.isEmpty())
+    configuration.setSessionTicket(session.ticket);
+  return configuration;
+}
+#endif
+
+void GirderRequest::applyTransportProfile(QNetworkRequest& request)
+{
+#if QT_VERSION >= QT_VERSION_CHECK(5, 8, 0)
+  request.setAttribute(QNetworkRequest::HTTP2AllowedAttribute,
+                       transportProfile() == TransportProfile::http2);
+#endif
+
+#ifndef QT_NO_SSL
+  if (request.url().scheme() == "https")
+    request.setSslConfiguration(sslConfiguration(request.url()));
+#endif
+}
+
+QNetworkRequest GirderRequest::girderNetworkRequest(const QUrl& url) const
+{
+  QNetworkRequest request(url);
+  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
+  applyTransportProfile(request);
+  return request;
+}
+
+void GirderRequest::sendGetRequest(const QNetworkRequest& request)
+{
+  GirderRateLimiter::instance()->acquire(m_trafficClass, this, [this, request]() {
+    if (!m_concurrencyLimiter) {
+      startGetRequest(request);
+      return;
+    }
+
+    m_concurrencyLimiter->acquire(
+      this, [this, request]() { startGetRequest(request); });
+  });
+}
+
+void GirderRequest::startGetRequest(const QNetworkRequest& request)
+{
+  QNetworkAccessManager* networkManager = m_networkManager;
+  GirderNetworkManagerPool* pool = networkManagerPool();
+  if (pool)
+    networkManager = pool->acquire();
+
+  auto reply = networkManager->get(request);
+  m_activeReply = reply;
+
+  if (pool) {
+    QObject::connect(reply,
+                     &QNetworkReply::finished,
+                     pool,
+                     [pool, networkManager]() { pool->release(networkManager); });
+  }
+
+  if (m_concurrencyLimiter) {
+    GirderConcurrencyLimiter* limiter = m_concurrencyLimiter;
+    GirderRetryPolicy policy = m_retryPolicy;
+    QElapsedTimer timer;
+    timer.start();
+
+    // The limiter is the context here so that the slot is released even if
+    // this request is deleted first.
+    QObject::connect(
+      reply, &QNetworkReply::finished, limiter, [reply, limiter, policy, timer]() {
+        if (reply->error() == QNetworkReply::OperationCanceledError)
+          limiter->release(-1, false);
+        else
+          limiter->release(timer.elapsed(), policy.isTransientError(reply));
+      });
+  }
+
+  // Charge the bytes to our traffic class as they arrive
+  GirderRateLimiter* rateLimiter = GirderRateLimiter::instance();
+  TrafficClass trafficClass = m_trafficClass;
+  auto charged = std::make_shared<qint64>(0);
+  QObject::connect(reply,
+                   &QNetworkReply::downloadProgress,
+                   rateLimiter,
+                   [rateLimiter, trafficClass, charged](qint64 received, qint64) {
+                     rateLimiter->consumeBytes(trafficClass, received - *charged);
+                     *charged = received;
+                   });
+  auto counted = std::make_shared<qint64>(0);
+  QObject::connect(reply,
+                   &QNetworkReply::downloadProgress,
+                   this,
+                   [this, counted](qint64 received, qint64) {
+                     m_bytesReceived += received - *counted;
+                     *counted = received;
+                   });
+
+  QObject::connect(reply, &QNetworkReply::finished, this, [this, reply]() {
+    if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 401)
+      emit unauthorized();
+  });
+
+  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+}
+
+bool GirderRequest::retryOnTransientError(QNetworkReply* reply)
+{
+  if (reply->error() == QNetworkReply::NoError) {
+    GirderRetryBudget::instance().deposit();
+    return false;
+  }
+
+  if (m_retryCount >= m_retryPolicy.maxRetries() ||
+      !m_retryPolicy.isTransientError(reply))
+    return false;
+
+  int delay = m_retryPolicy.retryDelay(reply, m_retryCount);
+  if (delay < 0 || !GirderRetryBudget::instance().withdraw())
+    return false;
+
+  ++m_retryCount;
+  emit info(QString("Retrying %1 in %2 ms (attempt %3 of %4)...")
+              .arg(reply->url().toString())
+              .arg(delay)
+              .arg(m_retryCount)
+              .arg(m_retryPolicy.maxRetries()));
+
+  // The timer is cancelled automatically if this request is deleted
+  QTimer::singleShot(delay, this, [this]() { send(); });
+  return true;
+}
 
 // We will use this for our unique_ptrs
 struct QObjectLaterDeleter
@@ -50,6 +255,59 @@ struct QObjectLaterDeleter
 template<typename T>
 using unique_ptr_delete_later = std::unique_ptr<T, QObjectLaterDeleter>;
 
+static QString objectUpdated(const QJsonObject& object)
+{
+  // Files are not updated, only created
+  return object.contains("updated") ? object.value("updated").toString()
+                                    : object.value("created").toString();
+}
+
+// Whether the "updated" time a is later than b. They are compared as
+// times, since the same time may be written with another precision or
+// offset.
+static bool isLater(const QString& a, const QString& b)
+{
+  QDateTime aTime = QDateTime::fromString(a, Qt::ISODate);
+  QDateTime bTime = QDateTime::fromString(b, Qt::ISODate);
+  if (!aTime.isValid() || !bTime.isValid())
+    return a > b;
+  return aTime > bTime;
+}
+
+// The details of a listed girder object: "id", "name", "size" in bytes,
+// and "updated", as the server formats it
+static QMap<QString, QString> objectDetails(const QString& id,
+                                            const QString& name,
+                                            const QJsonObject& object)
+{
+  QMap<QString, QString> details;
+  details["id"] = id;
+  details["name"] = name;
+  details["size"] = QString::number(static_cast<qint64>(object.value("size").toDouble(-1)));
+  details["updated"] = objectUpdated(object);
+  return details;
+}
+
+// A girder id, and a name of about the same size
+static const int listedBytesPerObject = 48;
+
+// Delta listings come newest first, a page at a time, until they reach
+// the high-water mark. Every page after the first one starts with the
+// last object of the previous one, which shows whether the objects moved
+// in between.
+static const int deltaPageSize = 1000;
+// How many times a delta listing starts over before giving up
+static const int maxDeltaRestarts = 3;
+
+static void addDeltaQueryItems(QUrlQuery& urlQuery, int offset)
+{
+  int overlap = offset > 0 ? 1 : 0;
+  urlQuery.addQueryItem("sort", "updated");
+  urlQuery.addQueryItem("sortdir", "-1");
+  urlQuery.addQueryItem("limit", QString::number(deltaPageSize + overlap));
+  urlQuery.addQueryItem("offset", QString::number(offset - overlap));
+}
+
 ListItemsRequest::ListItemsRequest(QNetworkAccessManager* networkManager,
                                    const QString& girderUrl,
                                    const QString& girderToken,
@@ -61,26 +319,34 @@ ListItemsRequest::ListItemsRequest(QNetworkAccessManager* networkManager,
 
 ListItemsRequest::~ListItemsRequest() {}
 
+void ListItemsRequest::setUpdatedSince(const QString& highWaterMark)
+{
+  m_updatedSince = highWaterMark;
+  m_highWaterMark = highWaterMark;
+}
+
 void ListItemsRequest::send()
 {
   QUrlQuery urlQuery;
   urlQuery.addQueryItem("folderId", m_folderId);
-  urlQuery.addQueryItem("limit", "0");
+  if (m_updatedSince.isEmpty())
+    urlQuery.addQueryItem("limit", "0");
+  else
+    addDeltaQueryItems(urlQuery, m_offset);
 
   QUrl url(QString("%1/item").arg(m_girderUrl));
   url.setQuery(urlQuery); // reconstructs the query string from the QUrlQuery
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void ListItemsRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -93,8 +359,33 @@ void ListItemsRequest::finished()
     }
 
     const QJsonArray& array = jsonResponse.array();
-    QMap<QString, QString> itemMap;
-    for (const auto& item : array) {
+
+    // Objects updated or removed since the last page shifted the ones
+    // after them, so paging on would skip some: start over
+    int first = 0;
+    if (!m_updatedSince.isEmpty() && m_offset > 0) {
+      if (array.isEmpty() ||
+          array.first().toObject().value("_id").toString() != m_lastListedId) {
+        if (++m_restarts > maxDeltaRestarts) {
+          emit error(QString("The items kept changing while being listed."));
+          return;
+        }
+        m_offset = 0;
+        m_listed = GirderListing();
+        m_listedObjects.clear();
+        m_highWaterMark = m_updatedSince;
+        resetRetryCount();
+        send();
+        return;
+      }
+      first = 1;
+    }
+
+    bool wantDetails = isSignalConnected(QMetaMethod::fromSignal(&ListItemsRequest::details));
+    m_listed.reserve(array.size(), array.size() * listedBytesPerObject);
+    bool reachedMark = false;
+    for (int i = first; i < array.size(); ++i) {
+      const QJsonValue& item = array.at(i);
       if (!item.isObject()) {
         emit error(QString("Invalid entry in QJsonArray"));
         break;
@@ -113,10 +404,34 @@ void ListItemsRequest::finished()
       }
       QString name = object.value("name").toString();
 
-      itemMap[id] = name;
+      QString updated = objectUpdated(object);
+      if (!m_updatedSince.isEmpty() && !isLater(updated, m_updatedSince)) {
+        reachedMark = true;
+        break;
+      }
+      if (isLater(updated, m_highWaterMark))
+        m_highWaterMark = updated;
+
+      m_listed.append(id, name);
+      m_lastListedId = id;
+      if (wantDetails)
+        m_listedObjects.append(objectDetails(id, name, object));
+    }
+
+    // The next page may still have items updated after the mark
+    if (!m_updatedSince.isEmpty() && !reachedMark && array.size() - first == deltaPageSize) {
+      m_offset += deltaPageSize;
+      // Every page gets its own retries
+      resetRetryCount();
+      send();
+      return;
     }
 
-    emit items(itemMap);
+    m_listed.finish();
+    emit details(m_listedObjects);
+    emit listing(m_listed);
+    if (isSignalConnected(QMetaMethod::fromSignal(&ListItemsRequest::items)))
+      emit items(m_listed.toMap());
   }
 }
 
@@ -138,17 +453,16 @@ void ListFilesRequest::send()
   urlQuery.addQueryItem("limit", "0");
   url.setQuery(urlQuery);
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void ListFilesRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -161,7 +475,10 @@ void ListFilesRequest::finished()
     }
 
     const QJsonArray& array = jsonResponse.array();
-    QMap<QString, QString> fileMap;
+    bool wantDetails = isSignalConnected(QMetaMethod::fromSignal(&ListFilesRequest::details));
+    GirderListing listed;
+    listed.reserve(array.size(), array.size() * listedBytesPerObject);
+    QList<QMap<QString, QString> > objects;
     for (const auto& item : array) {
       if (!item.isObject()) {
         emit error(QString("Invalid entry in QJsonArray"));
@@ -181,10 +498,16 @@ void ListFilesRequest::finished()
       }
       QString name = object.value("name").toString();
 
-      fileMap[id] = name;
+      listed.append(id, name);
+      if (wantDetails)
+        objects.append(objectDetails(id, name, object));
     }
 
-    emit files(fileMap);
+    listed.finish();
+    emit details(objects);
+    emit listing(listed);
+    if (isSignalConnected(QMetaMethod::fromSignal(&ListFilesRequest::files)))
+      emit files(listed.toMap());
   }
 }
 
@@ -201,27 +524,35 @@ ListFoldersRequest::ListFoldersRequest(QNetworkAccessManager* networkManager,
 
 ListFoldersRequest::~ListFoldersRequest() {}
 
+void ListFoldersRequest::setUpdatedSince(const QString& highWaterMark)
+{
+  m_updatedSince = highWaterMark;
+  m_highWaterMark = highWaterMark;
+}
+
 void ListFoldersRequest::send()
 {
   QUrlQuery urlQuery;
   urlQuery.addQueryItem("parentId", m_parentId);
   urlQuery.addQueryItem("parentType", m_parentType);
-  urlQuery.addQueryItem("limit", "0");
+  if (m_updatedSince.isEmpty())
+    urlQuery.addQueryItem("limit", "0");
+  else
+    addDeltaQueryItems(urlQuery, m_offset);
 
   QUrl url(QString("%1/folder").arg(m_girderUrl));
   url.setQuery(urlQuery); // reconstructs the query string from the QUrlQuery
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void ListFoldersRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -234,8 +565,33 @@ void ListFoldersRequest::finished()
     }
 
     const QJsonArray& array = jsonResponse.array();
-    QMap<QString, QString> folderMap;
-    for (const auto& item : array) {
+
+    // Objects updated or removed since the last page shifted the ones
+    // after them, so paging on would skip some: start over
+    int first = 0;
+    if (!m_updatedSince.isEmpty() && m_offset > 0) {
+      if (array.isEmpty() ||
+          array.first().toObject().value("_id").toString() != m_lastListedId) {
+        if (++m_restarts > maxDeltaRestarts) {
+          emit error(QString("The folders kept changing while being listed."));
+          return;
+        }
+        m_offset = 0;
+        m_listed = GirderListing();
+        m_listedObjects.clear();
+        m_highWaterMark = m_updatedSince;
+        resetRetryCount();
+        send();
+        return;
+      }
+      first = 1;
+    }
+
+    bool wantDetails = isSignalConnected(QMetaMethod::fromSignal(&ListFoldersRequest::details));
+    m_listed.reserve(array.size(), array.size() * listedBytesPerObject);
+    bool reachedMark = false;
+    for (int i = first; i < array.size(); ++i) {
+      const QJsonValue& item = array.at(i);
       if (!item.isObject()) {
         emit error(QString("Invalid entry in QJsonArray"));
         break;
@@ -254,13 +610,58 @@ void ListFoldersRequest::finished()
       }
       QString name = object.value("name").toString();
 
-      folderMap[id] = name;
+      QString updated = objectUpdated(object);
+      if (!m_updatedSince.isEmpty() && !isLater(updated, m_updatedSince)) {
+        reachedMark = true;
+        break;
+      }
+      if (isLater(updated, m_highWaterMark))
+        m_highWaterMark = updated;
+
+      m_listed.append(id, name);
+      m_lastListedId = id;
+      if (wantDetails)
+        m_listedObjects.append(objectDetails(id, name, object));
     }
 
-    emit folders(folderMap);
+    // The next page may still have folders updated after the mark
+    if (!m_updatedSince.isEmpty() && !reachedMark && array.size() - first == deltaPageSize) {
+      m_offset += deltaPageSize;
+      // Every page gets its own retries
+      resetRetryCount();
+      send();
+      return;
+    }
+
+    m_listed.finish();
+    emit details(m_listedObjects);
+    emit listing(m_listed);
+    if (isSignalConnected(QMetaMethod::fromSignal(&ListFoldersRequest::folders)))
+      emit folders(m_listed.toMap());
   }
 }
 
+void GirderRequest::forwardFirstError(GirderRequest* request)
+{
+  connect(request, &GirderRequest::error, this,
+    [this](const QString& message, QNetworkReply* networkReply) {
+      if (m_errorForwarded)
+        return;
+      m_errorForwarded = true;
+      emit error(message, networkReply);
+    });
+}
+
+// The requests made for the contents of a download are deleted once they
+// finish, like the download requests themselves
+template<typename T>
+static GirderFuture<T> deleteWhenFinished(GirderRequest* request, const GirderFuture<T>& future)
+{
+  future.subscribe([request](const T&) { request->deleteLater(); },
+                   [request](const QString&) { request->deleteLater(); });
+  return future;
+}
+
 DownloadFolderRequest::DownloadFolderRequest(
   QNetworkAccessManager* networkManager,
   const QString& girderUrl,
@@ -271,54 +672,51 @@ DownloadFolderRequest::DownloadFolderRequest(
   : GirderRequest(networkManager, girderUrl, girderToken, parent)
   , m_folderId(folderId)
   , m_downloadPath(downloadPath)
-  , m_itemsToDownload(NULL)
-  , m_foldersToDownload(NULL)
 {
   QDir(m_downloadPath).mkpath(".");
-}
 
-DownloadFolderRequest::~DownloadFolderRequest()
-{
-  delete m_itemsToDownload;
-  delete m_foldersToDownload;
+  // Folder downloads are bulk operations. The limiter is passed on to
+  // every request made for the folder's contents.
+  setConcurrencyLimiter(GirderConcurrencyLimiter::bulkLimiter());
 }
 
+DownloadFolderRequest::~DownloadFolderRequest() {}
+
 void DownloadFolderRequest::send()
 {
   ListItemsRequest* itemsRequest = new ListItemsRequest(
     m_networkManager, m_girderUrl, m_girderToken, m_folderId, this);
+  itemsRequest->setConcurrencyLimiter(concurrencyLimiter());
+  forwardFirstError(itemsRequest);
 
-  connect(itemsRequest,
-          SIGNAL(items(const QList<QString>)),
-          this,
-          SLOT(items(const QList<QString>)));
-  connect(itemsRequest,
-          SIGNAL(error(const QString, QNetworkReply*)),
-          this,
-          SIGNAL(error(const QString, QNetworkReply*)));
-
-  itemsRequest->send();
+  GirderFuture<bool> itemsDownloaded =
+    deleteWhenFinished(itemsRequest, sendAsync(itemsRequest, &ListItemsRequest::items))
+      .then([this](const QMap<QString, QString>& items) {
+        return downloadItems(items);
+      });
 
   ListFoldersRequest* foldersRequest = new ListFoldersRequest(
     m_networkManager, m_girderUrl, m_girderToken, m_folderId, "folder", this);
-
-  connect(foldersRequest,
-          SIGNAL(folders(const QMap<QString, QString>)),
-          this,
-          SLOT(folders(const QMap<QString, QString>)));
-  connect(foldersRequest,
-          SIGNAL(error(const QString, QNetworkReply*)),
-          this,
-          SIGNAL(error(const QString, QNetworkReply*)));
-
-  foldersRequest->send();
+  foldersRequest->setConcurrencyLimiter(concurrencyLimiter());
+  forwardFirstError(foldersRequest);
+
+  GirderFuture<bool> foldersDownloaded =
+    deleteWhenFinished(foldersRequest, sendAsync(foldersRequest, &ListFoldersRequest::folders))
+      .then([this](const QMap<QString, QString>& folders) {
+        return downloadFolders(folders);
+      });
+
+  // The error() of the request that failed was forwarded already
+  whenAll(QList<GirderFuture<bool>>{ itemsDownloaded, foldersDownloaded })
+    .subscribe([this](const QList<bool>&) { emit complete(); },
+               [](const QString&) {});
 }
 
-void DownloadFolderRequest::items(const QList<QString>& itemIds)
+GirderFuture<bool> DownloadFolderRequest::downloadItems(
+  const QMap<QString, QString>& items)
 {
-  m_itemsToDownload = new QList<QString>(itemIds);
-
-  foreach (QString itemId, itemIds) {
+  QList<GirderFuture<bool>> downloads;
+  for (const QString& itemId : items.keys()) {
     DownloadItemRequest* request = new DownloadItemRequest(m_networkManager,
                                                            m_girderUrl,
                                                            m_girderToken,
@@ -326,35 +724,19 @@ void DownloadFolderRequest::items(const QList<QString>& itemIds)
                                                            itemId,
                                                            this);
 
-    connect(request, SIGNAL(complete()), this, SLOT(downloadItemFinished()));
-    connect(request,
-            SIGNAL(error(const QString, QNetworkReply*)),
-            this,
-            SIGNAL(error(const QString, QNetworkReply*)));
-    connect(
-      request, SIGNAL(info(const QString)), this, SIGNAL(info(const QString)));
-    request->send();
+    request->setConcurrencyLimiter(concurrencyLimiter());
+    connect(request, &GirderRequest::info, this, &GirderRequest::info);
+    forwardFirstError(request);
+    downloads.append(deleteWhenFinished(request, sendAsync(request, &GirderRequest::complete)));
   }
-}
-
-void DownloadFolderRequest::downloadItemFinished()
-{
-  DownloadItemRequest* request =
-    qobject_cast<DownloadItemRequest*>(this->sender());
-
-  m_itemsToDownload->removeOne(request->itemId());
 
-  if (this->isComplete()) {
-    emit complete();
-  }
-
-  request->deleteLater();
+  return whenAll(downloads).then([](const QList<bool>&) { return true; });
 }
 
-void DownloadFolderRequest::folders(const QMap<QString, QString>& folders)
+GirderFuture<bool> DownloadFolderRequest::downloadFolders(
+  const QMap<QString, QString>& folders)
 {
-  m_foldersToDownload = new QMap<QString, QString>(folders);
-
+  QList<GirderFuture<bool>> downloads;
   QMapIterator<QString, QString> i(folders);
   while (i.hasNext()) {
     i.next();
@@ -364,36 +746,13 @@ void DownloadFolderRequest::folders(const QMap<QString, QString>& folders)
     DownloadFolderRequest* request = new DownloadFolderRequest(
       m_networkManager, m_girderUrl, m_girderToken, path, id, this);
 
-    connect(request, SIGNAL(complete()), this, SLOT(downloadFolderFinished()));
-    connect(request,
-            SIGNAL(error(const QString, QNetworkReply*)),
-            this,
-            SIGNAL(error(const QString, QNetworkReply*)));
-    connect(
-      request, SIGNAL(info(const QString)), this, SIGNAL(info(const QString)));
-
-    request->send();
+    request->setConcurrencyLimiter(concurrencyLimiter());
+    connect(request, &GirderRequest::info, this, &GirderRequest::info);
+    forwardFirstError(request);
+    downloads.append(deleteWhenFinished(request, sendAsync(request, &GirderRequest::complete)));
   }
-}
 
-void DownloadFolderRequest::downloadFolderFinished()
-{
-  DownloadFolderRequest* request =
-    qobject_cast<DownloadFolderRequest*>(this->sender());
-
-  m_foldersToDownload->remove(request->folderId());
-
-  if (this->isComplete()) {
-    emit complete();
-  }
-
-  request->deleteLater();
-}
-
-bool DownloadFolderRequest::isComplete()
-{
-  return (m_itemsToDownload && m_itemsToDownload->isEmpty() &&
-          m_foldersToDownload && m_foldersToDownload->isEmpty());
+  return whenAll(downloads).then([](const QList<bool>&) { return true; });
 }
 
 DownloadItemRequest::DownloadItemRequest(QNetworkAccessManager* networkManager,
@@ -414,24 +773,23 @@ void DownloadItemRequest::send()
   ListFilesRequest* request = new ListFilesRequest(
     m_networkManager, m_girderUrl, m_girderToken, m_itemId, this);
 
-  connect(request,
-          SIGNAL(files(const QMap<QString, QString>)),
-          this,
-          SLOT(files(const QMap<QString, QString>)));
-  connect(request,
-          SIGNAL(error(const QString, QNetworkReply*)),
-          this,
-          SIGNAL(error(const QString, QNetworkReply*)));
-  connect(
-    request, SIGNAL(info(const QString)), this, SIGNAL(info(const QString)));
-
-  request->send();
+  request->setConcurrencyLimiter(concurrencyLimiter());
+  connect(request, &GirderRequest::info, this, &GirderRequest::info);
+  forwardFirstError(request);
+
+  // The error() of the request that failed was forwarded already
+  deleteWhenFinished(request, sendAsync(request, &ListFilesRequest::files))
+    .then([this](const QMap<QString, QString>& files) {
+      return downloadFiles(files);
+    })
+    .subscribe([this](bool) { emit complete(); },
+               [](const QString&) {});
 }
 
-void DownloadItemRequest::files(const QMap<QString, QString>& files)
+GirderFuture<bool> DownloadItemRequest::downloadFiles(
+  const QMap<QString, QString>& files)
 {
-  m_filesToDownload = files;
-
+  QList<GirderFuture<bool>> downloads;
   QMapIterator<QString, QString> i(files);
   while (i.hasNext()) {
     i.next();
@@ -445,31 +803,13 @@ void DownloadItemRequest::files(const QMap<QString, QString>& files)
                                                            id,
                                                            this);
 
-    connect(request, SIGNAL(complete()), this, SLOT(fileDownloadFinish()));
-    connect(request,
-            SIGNAL(error(const QString, QNetworkReply*)),
-            this,
-            SIGNAL(error(const QString, QNetworkReply*)));
-    connect(
-      request, SIGNAL(info(const QString)), this, SIGNAL(info(const QString)));
-
-    request->send();
+    request->setConcurrencyLimiter(concurrencyLimiter());
+    connect(request, &GirderRequest::info, this, &GirderRequest::info);
+    forwardFirstError(request);
+    downloads.append(deleteWhenFinished(request, sendAsync(request, &GirderRequest::complete)));
   }
-}
-
-void DownloadItemRequest::fileDownloadFinish()
-{
-  DownloadFileRequest* request =
-    qobject_cast<DownloadFileRequest*>(this->sender());
 
-  m_filesToDownload.remove(request->fileId());
-
-  if (m_filesToDownload.isEmpty()) {
-    emit complete();
-    this->deleteLater();
-  }
-
-  request->deleteLater();
+  return whenAll(downloads).then([](const QList<bool>&) { return true; });
 }
 
 DownloadFileRequest::DownloadFileRequest(QNetworkAccessManager* networkManager,
@@ -483,9 +823,14 @@ DownloadFileRequest::DownloadFileRequest(QNetworkAccessManager* networkManager,
   , m_fileName(fileName)
   , m_fileId(fileId)
   , m_downloadPath(path)
+{
+  setTrafficClass(TrafficClass::download);
 
-  , m_retryCount(0)
-{}
+  // Girder sometimes answers file downloads with a spurious 400
+  GirderRetryPolicy policy = retryPolicy();
+  policy.addRetryableStatusCode(400);
+  setRetryPolicy(policy);
+}
 
 DownloadFileRequest::~DownloadFileRequest() {}
 
@@ -494,37 +839,29 @@ void DownloadFileRequest::send()
   QString girderAuthUrl =
     QString("%1/file/%2/download").arg(m_girderUrl).arg(m_fileId);
 
-  QNetworkRequest request(girderAuthUrl);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(QUrl(girderAuthUrl)));
 }
 
 void DownloadFileRequest::finished()
 {
   auto reply = qobject_cast<QNetworkReply*>(this->sender());
+  if (retryOnTransientError(reply)) {
+    reply->deleteLater();
+    return;
+  }
+
   if (reply->error()) {
     QByteArray bytes = reply->readAll();
-
-    int statusCode =
-      reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).value<int>();
-
-    if (statusCode == 400 && m_retryCount < 5) {
-      this->send();
-      m_retryCount++;
-    } else {
-      emit error(handleGirderError(reply, bytes), reply);
-    }
+    emit error(handleGirderError(reply, bytes), reply);
   } else {
     // We need todo the redirect ourselves!
     QUrl redirectUrl =
       reply->attribute(QNetworkRequest::RedirectionTargetAttribute).toUrl();
     if (!redirectUrl.isEmpty()) {
-      QNetworkRequest request;
-      request.setUrl(redirectUrl);
-      auto reply = m_networkManager->get(request);
-      QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+      reply->deleteLater();
+      QNetworkRequest request(redirectUrl);
+      applyTransportProfile(request);
+      sendGetRequest(request);
       return;
     }
 
@@ -562,17 +899,16 @@ void GetFolderParentRequest::send()
 {
   QUrl url(QString("%1/folder/%2").arg(m_girderUrl).arg(m_folderId));
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void GetFolderParentRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -624,17 +960,16 @@ void GetRootPathRequest::send()
              .arg(m_parentType)
              .arg(m_parentId));
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void GetRootPathRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -712,17 +1047,16 @@ void GetUsersRequest::send()
   QUrl url(QString("%1/user").arg(m_girderUrl));
   url.setQuery(urlQuery); // reconstructs the query string from the QUrlQuery
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void GetUsersRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -735,7 +1069,8 @@ void GetUsersRequest::finished()
     }
 
     const QJsonArray& array = jsonResponse.array();
-    QMap<QString, QString> usersMap;
+    GirderListing listed;
+    listed.reserve(array.size(), array.size() * listedBytesPerObject);
     for (const auto& item : array) {
       if (!item.isObject()) {
         emit error(QString("Invalid entry in QJsonArray"));
@@ -755,10 +1090,13 @@ void GetUsersRequest::finished()
       }
       QString login = object.value("login").toString();
 
-      usersMap[id] = login;
+      listed.append(id, login);
     }
 
-    emit users(usersMap);
+    listed.finish();
+    emit listing(listed);
+    if (isSignalConnected(QMetaMethod::fromSignal(&GetUsersRequest::users)))
+      emit users(listed.toMap());
   }
 }
 
@@ -780,17 +1118,16 @@ void GetCollectionsRequest::send()
   QUrl url(QString("%1/collection").arg(m_girderUrl));
   url.setQuery(urlQuery); // reconstructs the query string from the QUrlQuery
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void GetCollectionsRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -803,7 +1140,8 @@ void GetCollectionsRequest::finished()
     }
 
     const QJsonArray& array = jsonResponse.array();
-    QMap<QString, QString> collectionsMap;
+    GirderListing listed;
+    listed.reserve(array.size(), array.size() * listedBytesPerObject);
     for (const auto& item : array) {
       if (!item.isObject()) {
         emit error(QString("Invalid entry in QJsonArray"));
@@ -823,9 +1161,13 @@ void GetCollectionsRequest::finished()
       }
       QString name = object.value("name").toString();
 
-      collectionsMap[id] = name;
+      listed.append(id, name);
     }
-    emit collections(collectionsMap);
+
+    listed.finish();
+    emit listing(listed);
+    if (isSignalConnected(QMetaMethod::fromSignal(&GetCollectionsRequest::collections)))
+      emit collections(listed.toMap());
   }
 }
 
@@ -842,17 +1184,16 @@ void GetMyUserRequest::send()
 {
   QUrl url(QString("%1/user/me").arg(m_girderUrl));
 
-  QNetworkRequest request(url);
-  request.setRawHeader(QByteArray("Girder-Token"), m_girderToken.toUtf8());
-
-  auto reply = m_networkManager->get(request);
-  QObject::connect(reply, SIGNAL(finished()), this, SLOT(finished()));
+  sendGetRequest(girderNetworkRequest(url));
 }
 
 void GetMyUserRequest::finished()
 {
   unique_ptr_delete_later<QNetworkReply> reply(
     qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
   QByteArray bytes = reply->readAll();
   if (reply->error()) {
     emit error(handleGirderError(reply.get(), bytes), reply.get());
@@ -884,4 +1225,208 @@ void GetMyUserRequest::finished()
   }
 }
 
+LookupPathRequest::LookupPathRequest(QNetworkAccessManager* networkManager,
+                                     const QString& girderUrl,
+                                     const QString& girderToken,
+                                     const QString& path,
+                                     QObject* parent)
+  : GirderRequest(networkManager, girderUrl, girderToken, parent)
+  , m_path(path)
+{}
+
+LookupPathRequest::~LookupPathRequest() = default;
+
+void LookupPathRequest::send()
+{
+  QUrlQuery urlQuery;
+  urlQuery.addQueryItem("path", m_path);
+
+  QUrl url(QString("%1/resource/lookup").arg(m_girderUrl));
+  url.setQuery(urlQuery);
+
+  sendGetRequest(girderNetworkRequest(url));
+}
+
+void LookupPathRequest::finished()
+{
+  unique_ptr_delete_later<QNetworkReply> reply(
+    qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
+  QByteArray bytes = reply->readAll();
+  if (reply->error()) {
+    emit error(handleGirderError(reply.get(), bytes), reply.get());
+  } else {
+    QJsonDocument jsonResponse = QJsonDocument::fromJson(bytes.constData());
+
+    if (!jsonResponse.isObject()) {
+      emit error(QString("Invalid response to LookupPathRequest."));
+      return;
+    }
+
+    const QJsonObject& jsonObject = jsonResponse.object();
+
+    QMap<QString, QString> objectInfo;
+    if (!jsonObject.contains("_modelType")) {
+      emit error("Unable to extract model type.");
+      return;
+    }
+    objectInfo["type"] = jsonObject.value("_modelType").toString();
+
+    if (!jsonObject.contains("_id")) {
+      emit error("Unable to extract id.");
+      return;
+    }
+    objectInfo["id"] = jsonObject.value("_id").toString();
+
+    QString nameField = objectInfo["type"] == "user" ? "login" : "name";
+    if (!jsonObject.contains(nameField)) {
+      emit error("Unable to extract name.");
+      return;
+    }
+    objectInfo["name"] = jsonObject.value(nameField).toString();
+
+    emit object(objectInfo);
+  }
+}
+
+SearchResourcesRequest::SearchResourcesRequest(QNetworkAccessManager* networkManager,
+                                               const QString& girderUrl,
+                                               const QString& girderToken,
+                                               const QString& query,
+                                               const QStringList& types,
+                                               int offset,
+                                               int limit,
+                                               const QString& mode,
+                                               QObject* parent)
+  : GirderRequest(networkManager, girderUrl, girderToken, parent)
+  , m_query(query)
+  , m_types(types)
+  , m_offset(offset)
+  , m_limit(limit)
+  , m_mode(mode)
+{}
+
+SearchResourcesRequest::~SearchResourcesRequest() = default;
+
+void SearchResourcesRequest::send()
+{
+  QUrlQuery urlQuery;
+  urlQuery.addQueryItem("q", m_query);
+  urlQuery.addQueryItem("mode", m_mode);
+  urlQuery.addQueryItem(
+    "types", QJsonDocument(QJsonArray::fromStringList(m_types)).toJson(QJsonDocument::Compact));
+  urlQuery.addQueryItem("offset", QString::number(m_offset));
+  urlQuery.addQueryItem("limit", QString::number(m_limit));
+
+  QUrl url(QString("%1/resource/search").arg(m_girderUrl));
+  url.setQuery(urlQuery);
+
+  sendGetRequest(girderNetworkRequest(url));
+}
+
+void SearchResourcesRequest::finished()
+{
+  unique_ptr_delete_later<QNetworkReply> reply(
+    qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
+  QByteArray bytes = reply->readAll();
+  if (reply->error()) {
+    emit error(handleGirderError(reply.get(), bytes), reply.get());
+  } else {
+    QJsonDocument jsonResponse = QJsonDocument::fromJson(bytes.constData());
+
+    if (!jsonResponse.isObject()) {
+      emit error(QString("Invalid response to SearchResourcesRequest."));
+      return;
+    }
+
+    // The results are grouped by type
+    const QJsonObject& jsonObject = jsonResponse.object();
+    QList<QMap<QString, QString>> objects;
+    for (const QString& type : m_types) {
+      for (const auto& value : jsonObject.value(type).toArray()) {
+        const QJsonObject& object = value.toObject();
+
+        QMap<QString, QString> objectInfo;
+        objectInfo["type"] = type;
+        objectInfo["id"] = object.value("_id").toString();
+        objectInfo["name"] =
+          object.value(type == "user" ? "login" : "name").toString();
+        if (objectInfo["id"].isEmpty()) {
+          emit error("Unable to extract id.");
+          return;
+        }
+
+        if (type == "folder") {
+          objectInfo["parentType"] = object.value("parentCollection").toString();
+          objectInfo["parentId"] = object.value("parentId").toString();
+        } else if (type == "item") {
+          objectInfo["parentType"] = "folder";
+          objectInfo["parentId"] = object.value("folderId").toString();
+        }
+
+        objects.append(objectInfo);
+      }
+    }
+
+    emit results(objects);
+  }
+}
+
+GetDetailsRequest::GetDetailsRequest(QNetworkAccessManager* networkManager,
+                                     const QString& girderUrl,
+                                     const QString& girderToken,
+                                     const QString& objectId,
+                                     const QString& objectType,
+                                     QObject* parent)
+  : GirderRequest(networkManager, girderUrl, girderToken, parent)
+  , m_objectId(objectId)
+  , m_objectType(objectType)
+{}
+
+GetDetailsRequest::~GetDetailsRequest() = default;
+
+void GetDetailsRequest::send()
+{
+  QUrl url(QString("%1/%2/%3/details")
+             .arg(m_girderUrl)
+             .arg(m_objectType)
+             .arg(m_objectId));
+
+  sendGetRequest(girderNetworkRequest(url));
+}
+
+void GetDetailsRequest::finished()
+{
+  unique_ptr_delete_later<QNetworkReply> reply(
+    qobject_cast<QNetworkReply*>(this->sender()));
+  if (retryOnTransientError(reply.get()))
+    return;
+
+  QByteArray bytes = reply->readAll();
+  if (reply->error()) {
+    emit error(handleGirderError(reply.get(), bytes), reply.get());
+  } else {
+    QJsonDocument jsonResponse = QJsonDocument::fromJson(bytes.constData());
+
+    if (!jsonResponse.isObject()) {
+      emit error(QString("Invalid response to GetDetailsRequest."));
+      return;
+    }
+
+    const QJsonObject& jsonObject = jsonResponse.object();
+    QMap<QString, int> countMap;
+    for (const QString& key : QStringList{ "nFolders", "nItems" }) {
+      if (jsonObject.contains(key))
+        countMap[key] = jsonObject.value(key).toInt();
+    }
+
+    emit counts(countMap);
+  }
+}
+
 } // end namespace
@@ -19,10 +19,24 @@
 #include <QNetworkReply>
 #include <QObject>
 #include <QPair>
+#include <QPointer>
+#include <QStringList>
+
+#include "girderconcurrencylimiter.h"
+#include "girderfuture.h"
+#include "girderlisting.h"
+#include "girdernetworkmanagerpool.h"
+#include "girderratelimiter.h"
+#include "girderretrypolicy.h"
+
+#include <type_traits>
 
 class QNetworkAccessManager;
 class QNetworkCookieJar;
 class QNetworkReply;
+class QNetworkRequest;
+class QSslConfiguration;
+class QUrl;
 
 namespace cumulus
 {
@@ -40,15 +54,101 @@ public:
 
   void virtual send() = 0;
 
+  // The policy used to decide if failed replies should be retried
+  void setRetryPolicy(const GirderRetryPolicy& policy) { m_retryPolicy = policy; }
+  const GirderRetryPolicy& retryPolicy() const { return m_retryPolicy; }
+
+  // If a limiter is set, GET requests wait for a slot in its window before
+  // they are sent, and report their latency and errors back to it.
+  void setConcurrencyLimiter(GirderConcurrencyLimiter* limiter) { m_concurrencyLimiter = limiter; }
+  GirderConcurrencyLimiter* concurrencyLimiter() const { return m_concurrencyLimiter; }
+
+  // Which budget of the process-wide GirderRateLimiter this request's GETs
+  // draw from. The default is metadata.
+  using TrafficClass = GirderRateLimiter::TrafficClass;
+  void setTrafficClass(TrafficClass trafficClass) { m_trafficClass = trafficClass; }
+  TrafficClass trafficClass() const { return m_trafficClass; }
+
+  // If a pool is set, every GirderRequest sends its GETs through the least
+  // loaded manager of the pool instead of its own network manager. The
+  // pool is not owned, and should outlive the requests.
+  static void setNetworkManagerPool(GirderNetworkManagerPool* pool);
+  static GirderNetworkManagerPool* networkManagerPool();
+
+  // The transport profile applies to every request made from now on. With
+  // http2, requests may be multiplexed over a single HTTP/2 connection if
+  // the server supports it. This requires Qt 5.8 or newer.
+  enum class TransportProfile {
+    http1,
+    http2
+  };
+  static void setTransportProfile(TransportProfile profile);
+  static TransportProfile transportProfile();
+
+  // Resume the TLS session of ticket, and keep the tickets of new
+  // handshakes, in the requests to apiUrl only. Other hosts and the default
+  // SSL configuration are left alone. An empty apiUrl stops it.
+  static void setTlsSession(const QString& apiUrl, const QByteArray& ticket);
+#ifndef QT_NO_SSL
+  // The SSL configuration of the connections to url
+  static QSslConfiguration sslConfiguration(const QUrl& url);
+#endif
+
+  // Set the attributes of the current transport profile on request, and
+  // the TLS session of its server
+  static void applyTransportProfile(QNetworkRequest& request);
+
+  // Bytes received by the GETs of this request so far, retries included
+  qint64 bytesReceived() const { return m_bytesReceived; }
+
 signals:
   void complete();
   void error(const QString& msg, QNetworkReply* networkReply = NULL);
   void info(const QString& msg);
 
+  // Emitted when the server rejects the girder token of a GET (HTTP 401),
+  // before the error is reported
+  void unauthorized();
+
 protected:
+  // Create a network request for url that carries the girder token
+  QNetworkRequest girderNetworkRequest(const QUrl& url) const;
+
+  // Send a GET request once the rate limiter and the concurrency limiter
+  // allow it. The reply's finished() signal is connected to the finished()
+  // slot of the subclass.
+  void sendGetRequest(const QNetworkRequest& request);
+
+  // If the reply failed with a transient error, and both the retry policy
+  // and the global retry budget allow it, schedule send() to be called
+  // again and return true. The caller should then ignore the reply.
+  bool retryOnTransientError(QNetworkReply* reply);
+  // Requests sent in several parts call this before sending the next one
+  void resetRetryCount() { m_retryCount = 0; }
+
+  // Emit the first error() of request, made by this one for part of its
+  // work, as this request's own, with the reply it failed on. Later errors
+  // of such requests are dropped.
+  void forwardFirstError(GirderRequest* request);
+
   QString m_girderUrl;
   QString m_girderToken;
   QNetworkAccessManager* m_networkManager;
+
+private:
+  void startGetRequest(const QNetworkRequest& request);
+
+  GirderRetryPolicy m_retryPolicy;
+  int m_retryCount = 0;
+
+  QPointer<GirderConcurrencyLimiter> m_concurrencyLimiter;
+  TrafficClass m_trafficClass = TrafficClass::metadata;
+  qint64 m_bytesReceived = 0;
+
+  // Aborted if this request is deleted while waiting for it
+  QPointer<QNetworkReply> m_activeReply;
+
+  bool m_errorForwarded = false;
 };
 
 class ListItemsRequest : public GirderRequest
@@ -65,7 +165,22 @@ public:
 
   void send();
 
+  // Only list the items updated after highWaterMark, newest first, a page
+  // at a time. The listing starts over if items move between pages. Items
+  // that were removed are not noticed.
+  void setUpdatedSince(const QString& highWaterMark);
+  // The latest "updated" of the items listed, or the one given to
+  // setUpdatedSince() if none is later
+  QString highWaterMark() const { return m_highWaterMark; }
+
 signals:
+  // Emitted first, with the "id", "name", "size" and "updated" of every
+  // object
+  void details(const QList<QMap<QString, QString> >& objects);
+  // Then the listing, which is built in one buffer as the reply is parsed
+  void listing(const GirderListing& listing);
+  // And the same as a map. This and details() are only built when
+  // something is connected to them.
   void items(const QMap<QString, QString>& itemMap);
 
 private slots:
@@ -74,6 +189,15 @@ private slots:
 
 private:
   QString m_folderId;
+
+  QString m_updatedSince;
+  QString m_highWaterMark;
+  int m_offset = 0;
+  int m_restarts = 0;
+  // What the pages so far listed
+  GirderListing m_listed;
+  QString m_lastListedId;
+  QList<QMap<QString, QString> > m_listedObjects;
 };
 
 class ListFoldersRequest : public GirderRequest
@@ -91,7 +215,14 @@ public:
 
   void send();
 
+  // The same as for ListItemsRequest
+  void setUpdatedSince(const QString& highWaterMark);
+  QString highWaterMark() const { return m_highWaterMark; }
+
 signals:
+  // The same as for ListItemsRequest
+  void details(const QList<QMap<QString, QString> >& objects);
+  void listing(const GirderListing& listing);
   void folders(const QMap<QString, QString>& folders);
 
 private slots:
@@ -100,6 +231,14 @@ private slots:
 private:
   QString m_parentId;
   QString m_parentType;
+
+  QString m_updatedSince;
+  QString m_highWaterMark;
+  int m_offset = 0;
+  int m_restarts = 0;
+  GirderListing m_listed;
+  QString m_lastListedId;
+  QList<QMap<QString, QString> > m_listedObjects;
 };
 
 class ListFilesRequest : public GirderRequest
@@ -119,6 +258,9 @@ public:
   QString path() const { return m_path; };
 
 signals:
+  // The same as for ListItemsRequest
+  void details(const QList<QMap<QString, QString> >& objects);
+  void listing(const GirderListing& listing);
   void files(const QMap<QString, QString>& files);
 
 private slots:
@@ -146,19 +288,13 @@ public:
   QString folderId() const { return m_folderId; };
   QString downloadPath() const { return m_downloadPath; };
 
-private slots:
-  void items(const QList<QString>& itemIds);
-  void folders(const QMap<QString, QString>& folders);
-  void downloadItemFinished();
-  void downloadFolderFinished();
-
 private:
+  // Each of these resolves once every download it started is complete
+  GirderFuture<bool> downloadItems(const QMap<QString, QString>& items);
+  GirderFuture<bool> downloadFolders(const QMap<QString, QString>& folders);
+
   QString m_folderId;
   QString m_downloadPath;
-  QList<QString>* m_itemsToDownload;
-  QMap<QString, QString>* m_foldersToDownload;
-
-  bool isComplete();
 };
 
 class DownloadFileRequest : public GirderRequest
@@ -187,7 +323,6 @@ private:
   QString m_fileName;
   QString m_fileId;
   QString m_downloadPath;
-  int m_retryCount;
 };
 
 class DownloadItemRequest : public GirderRequest
@@ -207,15 +342,12 @@ public:
   QString itemId() const { return m_itemId; };
   QString downloadPath() const { return m_downloadPath; };
 
-private slots:
-  void files(const QMap<QString, QString>& fileIds);
-  void fileDownloadFinish();
-
 private:
+  // Resolves once every file is downloaded. files is <fileId => fileName>
+  GirderFuture<bool> downloadFiles(const QMap<QString, QString>& files);
+
   QString m_itemId;
   QString m_downloadPath;
-  // <fileId => fileName>
-  QMap<QString, QString> m_filesToDownload;
 };
 
 class GetFolderParentRequest : public GirderRequest
@@ -286,8 +418,9 @@ public:
   void send();
 
 signals:
-
   // <userId => loginName>
+  void listing(const GirderListing& listing);
+  // The same as a map, only built when something is connected to it
   void users(const QMap<QString, QString>& usersMap);
 
 private slots:
@@ -308,8 +441,9 @@ public:
   void send();
 
 signals:
-
   // <collectionId => collectionName>
+  void listing(const GirderListing& listing);
+  // The same as a map, only built when something is connected to it
   void collections(const QMap<QString, QString>& collectionsMap);
 
 private slots:
@@ -338,6 +472,139 @@ signals:
 private slots:
   void finished();
 };
+
+class LookupPathRequest : public GirderRequest
+{
+  Q_OBJECT
+
+public:
+  // path is a girder resource path, such as /collection/Data/run42/raw
+  // or /user/jdoe/Public
+  LookupPathRequest(QNetworkAccessManager* networkManager,
+    const QString& girderUrl,
+    const QString& girderToken,
+    const QString& path,
+    QObject* parent = 0);
+  ~LookupPathRequest();
+
+  void send();
+  QString path() const { return m_path; };
+
+signals:
+  // The object at path. Contains "type", "id", and "name".
+  void object(const QMap<QString, QString>& objectInfo);
+
+private slots:
+  void finished();
+
+private:
+  QString m_path;
+};
+
+class SearchResourcesRequest : public GirderRequest
+{
+  Q_OBJECT
+
+public:
+  // Search the names of objects of the given types, such as "folder" and
+  // "item". mode is "prefix" to match the start of names, or "text" for
+  // girder's full text search. Girder applies offset and limit to each
+  // type separately.
+  SearchResourcesRequest(QNetworkAccessManager* networkManager,
+    const QString& girderUrl,
+    const QString& girderToken,
+    const QString& query,
+    const QStringList& types,
+    int offset,
+    int limit,
+    const QString& mode = "prefix",
+    QObject* parent = 0);
+  ~SearchResourcesRequest();
+
+  void send();
+  QString query() const { return m_query; };
+
+signals:
+  // Every object contains "type", "id", and "name". Folders and items also
+  // contain the "parentType" and "parentId" of the object they are in.
+  void results(const QList<QMap<QString, QString> >& objects);
+
+private slots:
+  void finished();
+
+private:
+  QString m_query;
+  QStringList m_types;
+  int m_offset;
+  int m_limit;
+  QString m_mode;
+};
+
+class GetDetailsRequest : public GirderRequest
+{
+  Q_OBJECT
+
+public:
+  // objectType is "folder", "user", or "collection"
+  GetDetailsRequest(QNetworkAccessManager* networkManager,
+    const QString& girderUrl,
+    const QString& girderToken,
+    const QString& objectId,
+    const QString& objectType = "folder",
+    QObject* parent = 0);
+  ~GetDetailsRequest();
+
+  void send();
+
+signals:
+  // How many objects are in the object, as "nFolders" and, for folders,
+  // "nItems". This is much cheaper than listing them.
+  void counts(const QMap<QString, int>& counts);
+
+private slots:
+  void finished();
+
+private:
+  QString m_objectId;
+  QString m_objectType;
+};
+
+// Send request and return a future for the argument of resultSignal. The
+// future fails with the message of the first error() the request emits.
+// For example:
+//   GirderFuture<QMap<QString, QString> > items =
+//     sendAsync(request, &ListItemsRequest::items);
+template<typename Request, typename Owner, typename Arg>
+GirderFuture<typename std::decay<Arg>::type> sendAsync(Request* request,
+  void (Owner::*resultSignal)(Arg))
+{
+  using T = typename std::decay<Arg>::type;
+
+  GirderPromise<T> promise;
+  QObject::connect(
+    request, resultSignal, [promise](const T& value) { promise.resolve(value); });
+  QObject::connect(request, &GirderRequest::error, [promise](const QString& message) {
+    promise.reject(message);
+  });
+
+  request->send();
+  return promise.future();
+}
+
+// The same as above, for result signals without arguments such as
+// complete(). The future resolves to true.
+template<typename Request, typename Owner>
+GirderFuture<bool> sendAsync(Request* request, void (Owner::*resultSignal)())
+{
+  GirderPromise<bool> promise;
+  QObject::connect(request, resultSignal, [promise]() { promise.resolve(true); });
+  QObject::connect(request, &GirderRequest::error, [promise](const QString& message) {
+    promise.reject(message);
+  });
+
+  request->send();
+  return promise.future();
+}
 }
 
 #endif
@@ -0,0 +1,113 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girderretrypolicy.h"
+
+#include <QDateTime>
+#include <QNetworkReply>
+#include <QNetworkRequest>
+
+#include <algorithm>
+#include <random>
+
+namespace cumulus
+{
+
+GirderRetryPolicy::GirderRetryPolicy()
+  : m_retryableStatusCodes({ 408, 429, 502, 503, 504 })
+{
+}
+
+bool GirderRetryPolicy::isTransientError(QNetworkReply* reply) const
+{
+  if (!reply || reply->error() == QNetworkReply::NoError)
+    return false;
+
+  QVariant statusCode = reply->attribute(QNetworkRequest::HttpStatusCodeAttribute);
+  if (statusCode.isValid())
+    return m_retryableStatusCodes.contains(statusCode.toInt());
+
+  // No http status, so the failure happened at the network level.
+  switch (reply->error())
+  {
+    case QNetworkReply::ConnectionRefusedError:
+    case QNetworkReply::RemoteHostClosedError:
+    case QNetworkReply::TimeoutError:
+    case QNetworkReply::TemporaryNetworkFailureError:
+    case QNetworkReply::NetworkSessionFailedError:
+    case QNetworkReply::ProxyConnectionClosedError:
+    case QNetworkReply::ProxyTimeoutError:
+    case QNetworkReply::UnknownNetworkError:
+      return true;
+    default:
+      return false;
+  }
+}
+
+// Returns the Retry-After header in milliseconds, or -1 if there is none.
+// The header may either be a number of seconds or an http date.
+static qint64 retryAfterMsecs(QNetworkReply* reply)
+{
+  QByteArray header = reply->rawHeader("Retry-After").trimmed();
+  if (header.isEmpty())
+    return -1;
+
+  bool ok = false;
+  qint64 seconds = header.toLongLong(&ok);
+  if (ok)
+    return std::max<qint64>(seconds, 0) * 1000;
+
+  QDateTime date = QDateTime::fromString(QString::fromLatin1(header), Qt::RFC2822Date);
+  if (!date.isValid())
+    return -1;
+
+  return std::max<qint64>(QDateTime::currentDateTimeUtc().msecsTo(date), 0);
+}
+
+int GirderRetryPolicy::retryDelay(QNetworkReply* reply, int attempt) const
+{
+  qint64 retryAfter = retryAfterMsecs(reply);
+  if (retryAfter > m_maxRetryAfter)
+    return -1;
+  else if (retryAfter >= 0)
+    return static_cast<int>(retryAfter);
+
+  // Exponential backoff with full jitter
+  qint64 ceiling = m_baseDelay;
+  for (int i = 0; i < attempt && ceiling < m_maxDelay; ++i)
+    ceiling *= 2;
+  ceiling = std::min<qint64>(ceiling, m_maxDelay);
+
+  static std::mt19937 generator{ std::random_device{}() };
+  std::uniform_int_distribution<int> distribution(0, static_cast<int>(ceiling));
+  return distribution(generator);
+}
+
+GirderRetryBudget& GirderRetryBudget::instance()
+{
+  static GirderRetryBudget budget;
+  return budget;
+}
+
+bool GirderRetryBudget::withdraw()
+{
+  if (m_tokens < 1.0)
+    return false;
+
+  m_tokens -= 1.0;
+  return true;
+}
+
+void GirderRetryBudget::deposit()
+{
+  m_tokens = std::min(m_tokens + m_tokensPerSuccess, m_maxTokens);
+}
+
+} // end namespace
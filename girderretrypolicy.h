@@ -0,0 +1,88 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girderretrypolicy.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girderretrypolicy_h
+#define girderfilebrowser_girderretrypolicy_h
+
+#include <QSet>
+
+class QNetworkReply;
+
+namespace cumulus
+{
+
+// Decides whether a failed reply should be retried, and how long to wait
+// before doing so. The delay before retry n is a random value in
+// [0, min(maxDelay, baseDelay * 2^n)] ("full jitter"), unless the server
+// sent a Retry-After header, in which case that is honored instead.
+class GirderRetryPolicy
+{
+public:
+  GirderRetryPolicy();
+
+  // The maximum number of times a single request will be retried
+  void setMaxRetries(int retries) { m_maxRetries = retries; }
+  int maxRetries() const { return m_maxRetries; }
+
+  void setBaseDelay(int msecs) { m_baseDelay = msecs; }
+  int baseDelay() const { return m_baseDelay; }
+
+  void setMaxDelay(int msecs) { m_maxDelay = msecs; }
+  int maxDelay() const { return m_maxDelay; }
+
+  // If the server asks us to wait longer than this, we give up instead
+  void setMaxRetryAfter(int msecs) { m_maxRetryAfter = msecs; }
+  int maxRetryAfter() const { return m_maxRetryAfter; }
+
+  // Add an http status code that should be treated as transient
+  void addRetryableStatusCode(int statusCode) { m_retryableStatusCodes.insert(statusCode); }
+
+  // Did this reply fail in a way that is worth retrying?
+  bool isTransientError(QNetworkReply* reply) const;
+
+  // The delay in milliseconds before retry number "attempt" (starting at 0).
+  // Returns -1 if the server asked us to wait longer than maxRetryAfter().
+  int retryDelay(QNetworkReply* reply, int attempt) const;
+
+private:
+  int m_maxRetries = 5;
+  int m_baseDelay = 200;
+  int m_maxDelay = 10000;
+  int m_maxRetryAfter = 60000;
+  QSet<int> m_retryableStatusCodes;
+};
+
+// A process-wide budget shared by all requests. Every retry withdraws a
+// token and every successful reply deposits a fraction of one, so a server
+// that is failing everything quickly exhausts the budget and the requests
+// fail instead of turning into a retry storm.
+class GirderRetryBudget
+{
+public:
+  static GirderRetryBudget& instance();
+
+  // Returns false if there is no budget left for a retry
+  bool withdraw();
+  void deposit();
+
+private:
+  GirderRetryBudget() = default;
+
+  double m_tokens = 20.0;
+  const double m_maxTokens = 20.0;
+  const double m_tokensPerSuccess = 0.1;
+};
+
+} // end namespace
+
+#endif
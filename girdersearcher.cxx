@@ -0,0 +1,249 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdersearcher.h"
+
+#include "girderrequest.h"
+
+#include <QTimer>
+
+namespace cumulus
+{
+
+// Results of a query are shown again without asking the server for this
+// long, in msecs
+static const qint64 maxQueryAge = 5 * 60 * 1000;
+static const int maxQueries = 32;
+
+// Root paths are small, but there may be many of them
+static const int maxRootPaths = 5000;
+
+GirderSearcher::GirderSearcher(QNetworkAccessManager* networkManager, QObject* parent)
+  : QObject(parent)
+  , m_networkManager(networkManager)
+  , m_debounceTimer(new QTimer)
+{
+  m_debounceTimer->setSingleShot(true);
+  m_debounceTimer->setInterval(300);
+  connect(m_debounceTimer.get(), &QTimer::timeout, this, [this]() { searchNow(m_pendingText); });
+}
+
+GirderSearcher::~GirderSearcher()
+{
+  cancel();
+}
+
+void GirderSearcher::setApiUrl(const QString& url)
+{
+  if (url == m_apiUrl)
+    return;
+
+  cancel();
+  m_apiUrl = url;
+  m_query.clear();
+  m_queries.clear();
+  m_rootPaths.clear();
+}
+
+void GirderSearcher::setDebounceInterval(int msecs)
+{
+  m_debounceTimer->setInterval(msecs);
+}
+
+int GirderSearcher::debounceInterval() const
+{
+  return m_debounceTimer->interval();
+}
+
+QList<QMap<QString, QString> > GirderSearcher::results() const
+{
+  return m_queries.value(m_query).results;
+}
+
+void GirderSearcher::search(const QString& text)
+{
+  m_pendingText = text;
+  m_debounceTimer->start();
+}
+
+void GirderSearcher::searchNow(const QString& text)
+{
+  m_debounceTimer->stop();
+
+  QString query = text.trimmed();
+  if (query == m_query && m_request)
+    return;
+
+  cancel();
+  m_query = query;
+  if (query.isEmpty())
+  {
+    emit results(query, QList<QMap<QString, QString> >(), true);
+    return;
+  }
+
+  removeExpired();
+  auto it = m_queries.find(query);
+  if (it == m_queries.end())
+  {
+    it = m_queries.insert(query, Query());
+    it->age.start();
+  }
+  else if (!it->results.isEmpty() || it->complete)
+  {
+    emit results(query, it->results, it->complete);
+  }
+
+  if (!it->complete)
+    requestPage();
+}
+
+void GirderSearcher::cancel()
+{
+  m_debounceTimer->stop();
+
+  ++m_generation;
+  if (m_request)
+  {
+    // Deleting a request aborts its reply
+    m_request->disconnect();
+    m_request->deleteLater();
+  }
+  m_request.clear();
+}
+
+void GirderSearcher::removeExpired()
+{
+  for (auto it = m_queries.begin(); it != m_queries.end();)
+  {
+    if (it->age.elapsed() > maxQueryAge)
+      it = m_queries.erase(it);
+    else
+      ++it;
+  }
+
+  // Forget the oldest ones beyond the limit
+  while (m_queries.size() >= maxQueries)
+  {
+    auto oldest = m_queries.begin();
+    for (auto it = m_queries.begin(); it != m_queries.end(); ++it)
+    {
+      if (it->age.elapsed() > oldest->age.elapsed())
+        oldest = it;
+    }
+    m_queries.erase(oldest);
+  }
+}
+
+void GirderSearcher::requestPage()
+{
+  const Query& query = m_queries[m_query];
+
+  // Files are not searched by girder, so the items they are in are found
+  // instead
+  QStringList types = { "collection", "folder", "item", "user" };
+  auto* request = new SearchResourcesRequest(
+    m_networkManager, m_apiUrl, m_girderToken, m_query, types, query.nextOffset, m_pageSize);
+  request->setParent(this);
+  // Somebody is waiting for these
+  request->setTrafficClass(GirderRateLimiter::TrafficClass::interactive);
+  connect(request, &GirderRequest::unauthorized, this, [this]() {
+    cancel();
+    emit error("The girder token was rejected.");
+  });
+  m_request = request;
+
+  int generation = m_generation;
+  QString text = m_query;
+  sendAsync(request, &SearchResourcesRequest::results)
+    .subscribe(
+      [this, generation, text, request](const QList<QMap<QString, QString> >& objects) {
+        request->deleteLater();
+        if (generation != m_generation)
+          return;
+
+        // Girder pages each type separately, so there may be more as long
+        // as any type filled its page
+        QHash<QString, int> countPerType;
+        for (const auto& object : objects)
+          ++countPerType[object.value("type")];
+        bool more = false;
+        for (int count : countPerType)
+          more = more || count >= m_pageSize;
+
+        Query& query = m_queries[text];
+        query.results += objects;
+        query.nextOffset += m_pageSize;
+        query.complete = !more || query.results.size() >= m_maxResults;
+        while (query.results.size() > m_maxResults)
+          query.results.removeLast();
+
+        m_request.clear();
+        emit results(text, query.results, query.complete);
+        if (!query.complete)
+          requestPage();
+      },
+      [this, generation, request](const QString& message) {
+        request->deleteLater();
+        if (generation != m_generation)
+          return;
+
+        // The results so far are kept, and the next search for the same
+        // text asks for the rest
+        m_request.clear();
+        emit error(message);
+      });
+}
+
+GirderFuture<GirderSearcher::RootPath> GirderSearcher::rootPath(
+  const QMap<QString, QString>& object)
+{
+  QString type = object.value("type");
+  QString id = object.value("id");
+
+  auto it = m_rootPaths.constFind(id);
+  if (it != m_rootPaths.cend() && !it->isFailed())
+    return it.value();
+
+  // Users and collections are at the top
+  if (type != "folder" && type != "item")
+    return GirderFuture<RootPath>::resolved(RootPath());
+
+  if (m_rootPaths.size() >= maxRootPaths)
+    m_rootPaths.clear();
+
+  auto* request =
+    new GetRootPathRequest(m_networkManager, m_apiUrl, m_girderToken, id, type, this);
+  GirderFuture<RootPath> future = sendAsync(request, &GetRootPathRequest::rootPath);
+  future.subscribe([request](const RootPath&) { request->deleteLater(); },
+    [request](const QString&) { request->deleteLater(); });
+
+  m_rootPaths.insert(id, future);
+  return future;
+}
+
+bool GirderSearcher::hasRootPath(const QString& id) const
+{
+  auto it = m_rootPaths.constFind(id);
+  return it != m_rootPaths.cend() && it->isFinished() && !it->isFailed();
+}
+
+QString GirderSearcher::location(const QMap<QString, QString>& object, const RootPath& rootPath)
+{
+  if (rootPath.isEmpty())
+    return "/" + object.value("type");
+
+  QStringList names;
+  for (const auto& entry : rootPath)
+    names.append(entry.value("name"));
+  return "/" + rootPath.first().value("type") + "/" + names.join("/");
+}
+
+} // end namespace
@@ -0,0 +1,139 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdersearcher.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdersearcher_h
+#define girderfilebrowser_girdersearcher_h
+
+#include <QElapsedTimer>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+
+#include "girderfuture.h"
+
+#include <memory>
+
+class QNetworkAccessManager;
+class QTimer;
+
+namespace cumulus
+{
+
+class GirderRequest;
+
+// Searches the names of everything on the server with girder's
+// /resource/search, for what has not been crawled into a local index.
+// Queries are sent once typing pauses, and a new query cancels the one
+// before it. Results come a page at a time, and the results of recent
+// queries are kept, so that going back to one shows it at once and only
+// asks for the pages that are still missing.
+class GirderSearcher : public QObject
+{
+  Q_OBJECT
+
+public:
+  using RootPath = QList<QMap<QString, QString> >;
+
+  explicit GirderSearcher(QNetworkAccessManager* networkManager, QObject* parent = nullptr);
+  ~GirderSearcher() override;
+
+  // Cancels the current query, and forgets the results of the last server
+  void setApiUrl(const QString& url);
+  void setGirderToken(const QString& token) { m_girderToken = token; }
+
+  // How long typing has to pause before a query is sent, in msecs
+  void setDebounceInterval(int msecs);
+  int debounceInterval() const;
+
+  // Objects of each type asked for per page, and the most results kept
+  // for a query
+  void setPageSize(int size) { m_pageSize = size; }
+  int pageSize() const { return m_pageSize; }
+  void setMaxResults(int count) { m_maxResults = count; }
+  int maxResults() const { return m_maxResults; }
+
+  // The query shown by the last results(), and its results so far
+  QString query() const { return m_query; }
+  QList<QMap<QString, QString> > results() const;
+
+  // The root path of object, which contains "type" and "id", asked for the
+  // first time it is needed. Like GetRootPathRequest::rootPath(), it
+  // starts with a user or a collection, and ends with the folder object is
+  // in.
+  GirderFuture<RootPath> rootPath(const QMap<QString, QString>& object);
+  // Whether the root path of id is known already
+  bool hasRootPath(const QString& id) const;
+
+  // Where an object with rootPath is, such as /collection/Data/run42
+  static QString location(const QMap<QString, QString>& object, const RootPath& rootPath);
+
+public slots:
+  // Search for text once typing pauses
+  void search(const QString& text);
+  // Search for text now
+  void searchNow(const QString& text);
+
+  // Stop the current query. Its results so far are kept.
+  void cancel();
+
+signals:
+  // Emitted for every page of the current query, with all its results so
+  // far. Every object contains "type", "id", and "name". complete is true
+  // once there are no more pages, or maxResults() is reached.
+  void results(const QString& query,
+    const QList<QMap<QString, QString> >& objects,
+    bool complete);
+
+  void error(const QString& message);
+
+private:
+  struct Query
+  {
+    QList<QMap<QString, QString> > results;
+    int nextOffset = 0;
+    bool complete = false;
+    QElapsedTimer age;
+  };
+
+  void requestPage();
+  void removeExpired();
+
+  QNetworkAccessManager* m_networkManager;
+  QString m_apiUrl;
+  QString m_girderToken;
+
+  std::unique_ptr<QTimer> m_debounceTimer;
+  QString m_pendingText;
+
+  int m_pageSize = 50;
+  int m_maxResults = 500;
+
+  QString m_query;
+  QPointer<GirderRequest> m_request;
+  // Bumped by cancel() to drop the page that is still coming in
+  int m_generation = 0;
+
+  // Recent queries, by their text
+  QHash<QString, Query> m_queries;
+
+  // Root paths by object id, in flight or not
+  QHash<QString, GirderFuture<RootPath> > m_rootPaths;
+};
+
+} // end namespace
+
+#endif
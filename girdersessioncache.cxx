@@ -0,0 +1,78 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdersessioncache.h"
+
+namespace cumulus
+{
+
+// Tokens that expire within this many seconds are not used, since they
+// could expire in the middle of browsing.
+static const int minimumTokenLifetime = 60 * 60;
+
+GirderSessionCache::GirderSessionCache()
+  : m_settings(QSettings::UserScope, "Kitware", "girderfilebrowser")
+{
+}
+
+QString GirderSessionCache::group(const QString& apiUrl)
+{
+  // Slashes in the url would otherwise be taken as nested groups
+  return "sessions/" + QString::fromLatin1(apiUrl.toUtf8().toHex());
+}
+
+QString GirderSessionCache::lastApiUrl() const
+{
+  return m_settings.value("sessions/lastApiUrl").toString();
+}
+
+QString GirderSessionCache::token(const QString& apiUrl) const
+{
+  QDateTime expires = expiry(apiUrl);
+  if (!expires.isValid() ||
+      QDateTime::currentDateTimeUtc().secsTo(expires) < minimumTokenLifetime)
+  {
+    return QString();
+  }
+
+  return m_settings.value(group(apiUrl) + "/token").toString();
+}
+
+QDateTime GirderSessionCache::expiry(const QString& apiUrl) const
+{
+  return m_settings.value(group(apiUrl) + "/expiry").toDateTime();
+}
+
+void GirderSessionCache::store(const QString& apiUrl,
+  const QString& token,
+  const QDateTime& expiry,
+  const QByteArray& sessionTicket)
+{
+  m_settings.beginGroup(group(apiUrl));
+  m_settings.setValue("token", token);
+  m_settings.setValue("expiry", expiry.toUTC());
+  if (!sessionTicket.isEmpty())
+    m_settings.setValue("sessionTicket", sessionTicket);
+  m_settings.endGroup();
+
+  m_settings.setValue("sessions/lastApiUrl", apiUrl);
+}
+
+void GirderSessionCache::clear(const QString& apiUrl)
+{
+  m_settings.remove(group(apiUrl));
+}
+
+QByteArray GirderSessionCache::sessionTicket(const QString& apiUrl) const
+{
+  return m_settings.value(group(apiUrl) + "/sessionTicket").toByteArray();
+}
+
+} // end namespace
@@ -0,0 +1,65 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdersessioncache.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdersessioncache_h
+#define girderfilebrowser_girdersessioncache_h
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QSettings>
+#include <QString>
+
+namespace cumulus
+{
+
+// Remembers the girder token of the last session with every server, along
+// with its expiry and the TLS session ticket, in the per-user settings.
+// A later launch can then start browsing right away instead of
+// authenticating again, and resume the TLS session instead of doing a full
+// handshake. The token is stored in plain text, like a browser cookie.
+class GirderSessionCache
+{
+public:
+  GirderSessionCache();
+
+  // The api url of the most recently stored session
+  QString lastApiUrl() const;
+
+  // The token stored for apiUrl. This is empty if there is none, or if it
+  // expires too soon to be worth using.
+  QString token(const QString& apiUrl) const;
+  QDateTime expiry(const QString& apiUrl) const;
+
+  // sessionTicket may be empty if the server does not issue tickets
+  void store(const QString& apiUrl,
+    const QString& token,
+    const QDateTime& expiry,
+    const QByteArray& sessionTicket = QByteArray());
+
+  // Forget the session with apiUrl, for instance once the server rejected
+  // its token
+  void clear(const QString& apiUrl);
+
+  // The TLS session ticket stored for apiUrl, which may be empty. See
+  // GirderRequest::setTlsSession().
+  QByteArray sessionTicket(const QString& apiUrl) const;
+
+private:
+  static QString group(const QString& apiUrl);
+
+  mutable QSettings m_settings;
+};
+
+} // end namespace
+
+#endif
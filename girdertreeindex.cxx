@@ -0,0 +1,119 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdertreeindex.h"
+
+#include <QDataStream>
+#include <QStringList>
+
+namespace cumulus
+{
+
+GirderTreeIndex::GirderTreeIndex()
+  : GirderAncestorIndex("tree")
+{
+}
+
+GirderTreeIndex::~GirderTreeIndex()
+{
+  // The base class can no longer write the checkpoint
+  save();
+}
+
+bool GirderTreeIndex::readRecord(quint8 type, QDataStream& stream)
+{
+  if (type != checkpointRecord)
+    return false;
+
+  Checkpoint checkpoint;
+  stream >> checkpoint.root >> checkpoint.pending >> checkpoint.crawled;
+  if (stream.status() == QDataStream::Ok)
+    m_checkpoint = checkpoint;
+  return true;
+}
+
+void GirderTreeIndex::writeRecords(QDataStream& stream, bool all)
+{
+  if (!all && !m_checkpointModified)
+    return;
+
+  // Written after the entries, so that a resumed crawl never misses what
+  // the checkpoint says was listed
+  stream << checkpointRecord << m_checkpoint.root << m_checkpoint.pending
+         << m_checkpoint.crawled;
+  m_checkpointModified = false;
+}
+
+void GirderTreeIndex::clearRecords()
+{
+  m_checkpoint = Checkpoint();
+  m_checkpointModified = false;
+  m_names.clear();
+}
+
+void GirderTreeIndex::entryChanged(const QString& id)
+{
+  if (contains(id))
+    m_names.insert(id, entry(id).name);
+  else
+    m_names.remove(id);
+}
+
+void GirderTreeIndex::addChildren(const QMap<QString, QString>& parentInfo,
+  const QString& childType,
+  const QList<QMap<QString, QString> >& children)
+{
+  for (const auto& child : children)
+  {
+    Entry entry;
+    entry.name = child.value("name");
+    entry.type = childType;
+    entry.parentId = parentInfo.value("id");
+    entry.parentType = parentInfo.value("type");
+    entry.size = child.value("size", "-1").toLongLong();
+    entry.updated = child.value("updated");
+    insert(child.value("id"), entry);
+  }
+}
+
+QList<QMap<QString, QString> > GirderTreeIndex::rootPath(const QString& id) const
+{
+  QMap<QString, QString> object;
+  object["type"] = entry(id).type;
+  object["id"] = id;
+
+  // The ancestor whose parent is unknown is still part of the path
+  QList<QMap<QString, QString> > path;
+  QMap<QString, QString> missing;
+  if (!rootPath(object, path, missing) && !missing.isEmpty() && missing != object)
+    path.prepend(missing);
+  return path;
+}
+
+QString GirderTreeIndex::path(const QString& id) const
+{
+  QStringList names;
+  QList<QMap<QString, QString> > ancestors = rootPath(id);
+  for (const auto& ancestor : ancestors)
+    names.append(ancestor.value("name"));
+  names.append(entry(id).name);
+
+  // Paths start with the type of the top object
+  QString top = ancestors.isEmpty() ? entry(id).type : ancestors.front().value("type");
+  return "/" + top + "/" + names.join('/');
+}
+
+void GirderTreeIndex::setCheckpoint(const Checkpoint& checkpoint)
+{
+  m_checkpoint = checkpoint;
+  m_checkpointModified = true;
+}
+
+} // end namespace
@@ -0,0 +1,90 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdertreeindex.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdertreeindex_h
+#define girderfilebrowser_girdertreeindex_h
+
+#include <QList>
+#include <QMap>
+#include <QString>
+
+#include "girderancestorindex.h"
+#include "girdertrigramindex.h"
+
+namespace cumulus
+{
+
+// Every object found by GirderCrawler: its name, type, parent, size and
+// last update. The index of each server is kept in a file of its own,
+// together with the state of the crawl, so that an interrupted crawl can
+// resume where it stopped.
+class GirderTreeIndex : public GirderAncestorIndex
+{
+public:
+  // What is left of a crawl
+  struct Checkpoint
+  {
+    // The object the crawl started from
+    QMap<QString, QString> root;
+    // The objects whose contents were not listed yet, with "type" and "id"
+    QList<QMap<QString, QString> > pending;
+    int crawled = 0;
+  };
+
+  GirderTreeIndex();
+  ~GirderTreeIndex() override;
+
+  // The objects listed in parentInfo, each with the "id", "name", "size"
+  // and "updated" of ListFoldersRequest::details() and the like
+  using GirderAncestorIndex::addChildren;
+  void addChildren(const QMap<QString, QString>& parentInfo,
+    const QString& childType,
+    const QList<QMap<QString, QString> >& children);
+
+  // The ancestors of id, from the user or collection at the top down to
+  // its parent, with "type", "id", and "name" for every entry. Stops at the
+  // first ancestor whose parent is unknown.
+  using GirderAncestorIndex::rootPath;
+  QList<QMap<QString, QString> > rootPath(const QString& id) const;
+
+  // The girder path of id, such as /collection/Data/run42/raw.txt
+  QString path(const QString& id) const;
+
+  // The names of the index, to search them
+  const GirderTrigramIndex& names() const { return m_names; }
+
+  // The checkpoint is saved with the entries, by save()
+  void setCheckpoint(const Checkpoint& checkpoint);
+  const Checkpoint& checkpoint() const { return m_checkpoint; }
+  bool hasCheckpoint() const { return !m_checkpoint.root.isEmpty(); }
+  void clearCheckpoint() { setCheckpoint(Checkpoint()); }
+
+protected:
+  bool readRecord(quint8 type, QDataStream& stream) override;
+  void writeRecords(QDataStream& stream, bool all) override;
+  void clearRecords() override;
+  void entryChanged(const QString& id) override;
+
+private:
+  // The record of the checkpoint in the file. The last one is the current
+  // one.
+  static const quint8 checkpointRecord = userRecord;
+
+  Checkpoint m_checkpoint;
+  bool m_checkpointModified = false;
+  GirderTrigramIndex m_names;
+};
+
+} // end namespace
+
+#endif
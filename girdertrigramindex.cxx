@@ -0,0 +1,147 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+
+#include "girdertrigramindex.h"
+
+#include <QSet>
+
+#include <algorithm>
+#include <iterator>
+
+namespace cumulus
+{
+
+quint64 GirderTrigramIndex::trigram(const QChar* characters)
+{
+  return (static_cast<quint64>(characters[0].unicode()) << 32) |
+    (static_cast<quint64>(characters[1].unicode()) << 16) | characters[2].unicode();
+}
+
+void GirderTrigramIndex::insert(const QString& id, const QString& name)
+{
+  auto it = m_positions.constFind(id);
+  if (it != m_positions.cend())
+  {
+    if (m_names[it.value()] == name.toLower())
+      return;
+    remove(id);
+  }
+
+  append(id, name.toLower());
+}
+
+void GirderTrigramIndex::remove(const QString& id)
+{
+  auto it = m_positions.find(id);
+  if (it == m_positions.end())
+    return;
+
+  // The postings of the name are left behind, and skipped by search()
+  m_ids[it.value()].clear();
+  m_names[it.value()].clear();
+  m_positions.erase(it);
+  ++m_removed;
+
+  if (m_removed > 1024 && m_removed > m_ids.size() / 2)
+    compact();
+}
+
+void GirderTrigramIndex::clear()
+{
+  m_ids.clear();
+  m_names.clear();
+  m_positions.clear();
+  m_removed = 0;
+  m_postings.clear();
+}
+
+void GirderTrigramIndex::append(const QString& id, const QString& name)
+{
+  int position = m_ids.size();
+  m_ids.append(id);
+  m_names.append(name);
+  m_positions.insert(id, position);
+
+  // Positions are added in order, so every posting list stays sorted.
+  // A name that repeats a trigram is only added once.
+  for (int i = 0; i + 3 <= name.size(); ++i)
+  {
+    QVector<int>& postings = m_postings[trigram(name.constData() + i)];
+    if (postings.isEmpty() || postings.last() != position)
+      postings.append(position);
+  }
+}
+
+void GirderTrigramIndex::compact()
+{
+  QVector<QString> ids = m_ids;
+  QVector<QString> names = m_names;
+  clear();
+
+  m_ids.reserve(ids.size());
+  m_names.reserve(ids.size());
+  for (int i = 0; i < ids.size(); ++i)
+  {
+    if (!ids[i].isEmpty())
+      append(ids[i], names[i]);
+  }
+}
+
+QStringList GirderTrigramIndex::search(const QString& text, int limit) const
+{
+  QString query = text.toLower();
+  if (query.size() < 3)
+    return QStringList();
+
+  QSet<quint64> trigrams;
+  for (int i = 0; i + 3 <= query.size(); ++i)
+    trigrams.insert(trigram(query.constData() + i));
+
+  QList<const QVector<int>*> postings;
+  for (quint64 key : trigrams)
+  {
+    auto it = m_postings.constFind(key);
+    if (it == m_postings.cend())
+      return QStringList();
+    postings.append(&it.value());
+  }
+
+  // Start from the rarest trigram, so the intersection stays small
+  std::sort(postings.begin(), postings.end(),
+    [](const QVector<int>* a, const QVector<int>* b) { return a->size() < b->size(); });
+
+  QVector<int> candidates = *postings.front();
+  for (int i = 1; i < postings.size() && !candidates.isEmpty(); ++i)
+  {
+    QVector<int> intersection;
+    std::set_intersection(candidates.cbegin(), candidates.cend(), postings[i]->cbegin(),
+      postings[i]->cend(), std::back_inserter(intersection));
+    candidates = intersection;
+  }
+
+  // Having every trigram does not mean having them in order
+  QVector<int> matches;
+  for (int position : candidates)
+  {
+    // Names that were replaced or removed are empty
+    if (m_names[position].contains(query))
+      matches.append(position);
+  }
+
+  std::stable_sort(matches.begin(), matches.end(),
+    [this](int a, int b) { return m_names[a].size() < m_names[b].size(); });
+
+  QStringList ids;
+  for (int i = 0; i < matches.size() && i < limit; ++i)
+    ids.append(m_ids[matches[i]]);
+  return ids;
+}
+
+} // end namespace
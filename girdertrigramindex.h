@@ -0,0 +1,65 @@
+//=========================================================================
+//  Copyright (c) Kitware, Inc.
+//  All rights reserved.
+//  See LICENSE.txt for details.
+//
+//  This software is distributed WITHOUT ANY WARRANTY; without even
+//  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+//  PURPOSE.  See the above copyright notice for more information.
+//=========================================================================
+// .NAME girdertrigramindex.h
+// .SECTION Description
+// .SECTION See Also
+
+#ifndef girderfilebrowser_girdertrigramindex_h
+#define girderfilebrowser_girdertrigramindex_h
+
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+namespace cumulus
+{
+
+// Finds the objects whose name contains some text. Every run of three
+// characters of every name points to the names that contain it, so a
+// search only looks at names that have all the runs of the text, instead
+// of at every name. Names are indexed as they come, so it is kept up to
+// date by GirderTreeIndex as a crawl adds to it.
+class GirderTrigramIndex
+{
+public:
+  // Index the name of id, in place of the one indexed for it before
+  void insert(const QString& id, const QString& name);
+  void remove(const QString& id);
+  void clear();
+
+  // The ids of up to limit objects whose name contains text, ignoring
+  // case. Shorter names come first. Text shorter than three characters
+  // has no runs to look up, and finds nothing.
+  QStringList search(const QString& text, int limit = 200) const;
+
+  // The number of names indexed
+  int size() const { return m_positions.size(); }
+
+private:
+  static quint64 trigram(const QChar* characters);
+
+  void append(const QString& id, const QString& name);
+  // Index the names again without the ones that were replaced or removed
+  void compact();
+
+  // Empty for names that were replaced or removed
+  QVector<QString> m_ids;
+  // Lower case
+  QVector<QString> m_names;
+  QHash<QString, int> m_positions;
+  int m_removed = 0;
+  // Positions in m_ids of the names that contain each trigram, in order
+  QHash<quint64, QVector<int> > m_postings;
+};
+
+} // end namespace
+
+#endif
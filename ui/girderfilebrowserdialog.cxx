@@ -11,14 +11,21 @@
 #include "girderfilebrowserdialog.h"
 #include "ui_girderfilebrowserdialog.h"
 
+#include "girdercrawler.h"
 #include "girderfilebrowserfetcher.h"
+#include "girdersearcher.h"
 
+#include <QCheckBox>
+#include <QHash>
 #include <QLabel>
+#include <QLineEdit>
 #include <QMessageBox>
 #include <QNetworkAccessManager>
 #include <QPushButton>
 #include <QRegularExpression>
+#include <QSettings>
 #include <QStandardItemModel>
+#include <QTimer>
 
 namespace cumulus
 {
@@ -60,8 +67,11 @@ GirderFileBrowserDialog::GirderFileBrowserDialog(QNetworkAccessManager* networkM
   , m_ui(new Ui::GirderFileBrowserDialog)
   , m_itemModel(new QStandardItemModel(this))
   , m_girderFileBrowserFetcher(new GirderFileBrowserFetcher(m_networkManager))
+  , m_crawler(new GirderCrawler(m_networkManager))
+  , m_searcher(new GirderSearcher(m_networkManager))
   , m_rootFolder(customRootFolder)
   , m_choosableTypes(ALL_OBJECT_TYPES)
+  , m_prefetchTimer(new QTimer)
   , m_folderIcon(new QIcon(":/icons/folder.png"))
   , m_fileIcon(new QIcon(":/icons/file.png"))
 {
@@ -108,13 +118,30 @@ GirderFileBrowserDialog::GirderFileBrowserDialog(QNetworkAccessManager* networkM
       {
         int row = current.row();
         if (row < m_cachedRowInfo.size() &&
-            m_choosableTypes.contains(m_cachedRowInfo[row]["type"]))
+            m_choosableTypes.contains(m_cachedRowInfo.at(row).value("type")))
         {
           m_ui->push_chooseObject->setEnabled(true);
         }
       }
     });
 
+  // Start listing the folder under the mouse or the selection after a
+  // short dwell, so that it opens without waiting if it is activated
+  m_ui->list_fileBrowser->setMouseTracking(true);
+  m_prefetchTimer->setSingleShot(true);
+  m_prefetchTimer->setInterval(250);
+  connect(m_ui->list_fileBrowser,
+    &QAbstractItemView::entered,
+    this,
+    &GirderFileBrowserDialog::schedulePrefetch);
+  connect(m_ui->list_fileBrowser->selectionModel(),
+    &QItemSelectionModel::currentChanged,
+    this,
+    &GirderFileBrowserDialog::schedulePrefetch);
+  connect(m_prefetchTimer.get(), &QTimer::timeout, this, [this]() {
+    m_girderFileBrowserFetcher->prefetchFolder(m_prefetchCandidate);
+  });
+
   // Change folder
   connect(this,
     &GirderFileBrowserDialog::changeFolder,
@@ -123,16 +150,73 @@ GirderFileBrowserDialog::GirderFileBrowserDialog(QNetworkAccessManager* networkM
     &GirderFileBrowserDialog::changeFolder,
     m_girderFileBrowserFetcher.get(),
     &GirderFileBrowserFetcher::getFolderInformation);
+  // Change folder by path
+  connect(this,
+    &GirderFileBrowserDialog::changePath,
+    [this](){ this->setCursor(Qt::WaitCursor); });
+  connect(this,
+    &GirderFileBrowserDialog::changePath,
+    m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::getFolderInformationFromPath);
   // Finish changing folder
   connect(m_girderFileBrowserFetcher.get(),
     &GirderFileBrowserFetcher::folderInformation,
     this,
     &GirderFileBrowserDialog::finishChangingFolder);
+  // The current folder changed on the server
+  connect(m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::folderContentsChanged,
+    this,
+    &GirderFileBrowserDialog::updateFolderContents);
   // An error occurred while changing folders
   connect(m_girderFileBrowserFetcher.get(),
     &GirderFileBrowserFetcher::error,
     this,
     &GirderFileBrowserDialog::errorReceived);
+  connect(m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::startupTrace,
+    this,
+    &GirderFileBrowserDialog::startupTrace);
+  connect(m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::prefetchStatistics,
+    this,
+    &GirderFileBrowserDialog::prefetchStatistics);
+  connect(m_crawler.get(),
+    &GirderCrawler::progress,
+    this,
+    &GirderFileBrowserDialog::indexProgress);
+  connect(m_crawler.get(),
+    &GirderCrawler::finished,
+    this,
+    &GirderFileBrowserDialog::indexFinished);
+  connect(m_crawler.get(), &GirderCrawler::error, this, [](const QString& message) {
+    qDebug() << "Indexing stopped:" << message;
+  });
+  // Offline, the listings are stored ones
+  m_ui->label_offline->hide();
+  connect(m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::offlineChanged,
+    this,
+    &GirderFileBrowserDialog::updateOfflineLabel);
+  // Pages of server search results
+  connect(m_searcher.get(),
+    &GirderSearcher::results,
+    this,
+    [this](const QString& query) {
+      if (m_ui->check_searchIndex->isChecked() && query == m_rowsMatchExpression.trimmed())
+        showSearchResults();
+    });
+  connect(m_searcher.get(), &GirderSearcher::error, this, [](const QString& message) {
+    qDebug() << "Search failed:" << message;
+  });
+  // The girder token was rejected
+  connect(m_girderFileBrowserFetcher.get(),
+    &GirderFileBrowserFetcher::authenticationRequired,
+    this,
+    [this]() {
+      setCursor(Qt::ArrowCursor);
+      emit authenticationRequired();
+    });
 
   bool usingCustomRootFolder = false;
   if (!m_rootFolder.isEmpty() && isRootInfoValid(m_rootFolder))
@@ -176,12 +260,27 @@ GirderFileBrowserDialog::GirderFileBrowserDialog(QNetworkAccessManager* networkM
     &QLineEdit::textEdited,
     this,
     &GirderFileBrowserDialog::changeVisibleRows);
+  // Or search the index instead
+  connect(m_ui->check_searchIndex,
+    &QCheckBox::toggled,
+    this,
+    &GirderFileBrowserDialog::setSearching);
 
   // Reset the filter text when we change folders
   connect(this, &GirderFileBrowserDialog::changeFolder, m_ui->edit_matchesExpression, [this]() {
     m_ui->edit_matchesExpression->setText("");
     m_rowsMatchExpression = "";
   });
+  connect(this, &GirderFileBrowserDialog::changePath, m_ui->edit_matchesExpression, [this]() {
+    m_ui->edit_matchesExpression->setText("");
+    m_rowsMatchExpression = "";
+  });
+
+  // Going elsewhere while the saved location is listed again cancels that
+  auto stopRevalidating = [this]() { m_revalidatingLocation = false; };
+  connect(this, &GirderFileBrowserDialog::changeFolder, this, stopRevalidating);
+  connect(this, &GirderFileBrowserDialog::changePath, this, stopRevalidating);
+  connect(this, &GirderFileBrowserDialog::goHome, this, stopRevalidating);
 
   if (!usingCustomRootFolder)
   {
@@ -199,6 +298,120 @@ GirderFileBrowserDialog::GirderFileBrowserDialog(QNetworkAccessManager* networkM
 
 GirderFileBrowserDialog::~GirderFileBrowserDialog() = default;
 
+void GirderFileBrowserDialog::begin()
+{
+  m_hasStarted = true;
+
+  // Finish indexing what an earlier session started
+  if (m_crawler->canResume())
+    m_crawler->resume();
+
+  QMap<QString, QString> parentInfo;
+  QList<QMap<QString, QString> > rootPath;
+  if (loadLocation(parentInfo, rootPath))
+  {
+    // Show the saved location from the stored listings, however old, and
+    // update its rows once it is listed again
+    QList<QMap<QString, QString> > folders;
+    QList<QMap<QString, QString> > files;
+    if (m_girderFileBrowserFetcher->storedFolderInformation(parentInfo, folders, files))
+    {
+      m_currentParentInfo = parentInfo;
+      m_currentRootPathInfo = rootPath;
+      m_currentFolders = folders;
+      m_currentFiles = files;
+      showRows(folders, files);
+      updateRootPathWidget();
+    }
+    else
+    {
+      setCursor(Qt::WaitCursor);
+    }
+
+    m_revalidatingLocation = true;
+    m_girderFileBrowserFetcher->prefetchStartup(parentInfo);
+    m_girderFileBrowserFetcher->revalidateFolderInformation(parentInfo, rootPath);
+    return;
+  }
+
+  m_girderFileBrowserFetcher->prefetchStartup(m_rootFolder);
+  emit changeFolder(m_rootFolder);
+}
+
+static QVariantList toVariantList(const QList<QMap<QString, QString> >& list)
+{
+  QVariantList variantList;
+  for (const auto& map : list)
+  {
+    QVariantMap variantMap;
+    for (const auto& key : map.keys())
+      variantMap[key] = map.value(key);
+    variantList.append(variantMap);
+  }
+  return variantList;
+}
+
+static QList<QMap<QString, QString> > fromVariantList(const QVariantList& variantList)
+{
+  QList<QMap<QString, QString> > list;
+  for (const auto& variant : variantList)
+  {
+    QVariantMap variantMap = variant.toMap();
+    QMap<QString, QString> map;
+    for (const auto& key : variantMap.keys())
+      map[key] = variantMap.value(key).toString();
+    list.append(map);
+  }
+  return list;
+}
+
+QString GirderFileBrowserDialog::locationSettingsGroup() const
+{
+  // A location is only meaningful on the same server, under the same root
+  QString key = m_apiUrl + " " + m_rootFolder.value("id");
+  return "lastLocation/" + QString::fromLatin1(key.toUtf8().toHex());
+}
+
+void GirderFileBrowserDialog::saveLocation()
+{
+  if (m_apiUrl.isEmpty())
+    return;
+
+  QSettings settings(QSettings::UserScope, "Kitware", "girderfilebrowser");
+  settings.beginGroup(locationSettingsGroup());
+  settings.setValue("parent", toVariantList({ m_currentParentInfo }));
+  settings.setValue("rootPath", toVariantList(m_currentRootPathInfo));
+  // The listing is in the listing store. Earlier versions kept it here.
+  settings.remove("folders");
+  settings.remove("files");
+  settings.endGroup();
+}
+
+bool GirderFileBrowserDialog::loadLocation(QMap<QString, QString>& parentInfo,
+  QList<QMap<QString, QString> >& rootPath) const
+{
+  if (m_apiUrl.isEmpty())
+    return false;
+
+  QSettings settings(QSettings::UserScope, "Kitware", "girderfilebrowser");
+  settings.beginGroup(locationSettingsGroup());
+  QList<QMap<QString, QString> > parent = fromVariantList(settings.value("parent").toList());
+
+  // The root folder is cheap to show anyway
+  if (parent.size() != 1 || parent[0].value("id").isEmpty())
+    return false;
+
+  parentInfo = parent[0];
+  rootPath = fromVariantList(settings.value("rootPath").toList());
+  return true;
+}
+
+void GirderFileBrowserDialog::forgetLocation()
+{
+  QSettings settings(QSettings::UserScope, "Kitware", "girderfilebrowser");
+  settings.remove(locationSettingsGroup());
+}
+
 // A convenience function for estimating button width
 static int buttonWidth(QPushButton* button)
 {
@@ -252,9 +465,11 @@ void GirderFileBrowserDialog::updateRootPathWidget()
   bool rootButtonAdded = false;
   if (m_rootPathOffset == 0)
   {
-    // This button doesn't do anything... it is only here for consistency
+    // The current folder. Pressing it allows typing a path instead.
     QPushButton* firstButton = new QPushButton(currentParentName() + "/", parentWidget);
     firstButton->setAutoDefault(false);
+    firstButton->setToolTip("Type a path to go to");
+    connect(firstButton, &QPushButton::pressed, this, &GirderFileBrowserDialog::editPath);
     layout->insertWidget(1, firstButton);
 
     totalWidgetWidth += buttonWidth(firstButton);
@@ -277,7 +492,7 @@ void GirderFileBrowserDialog::updateRootPathWidget()
 
     const auto& rootPathItem = *it;
 
-    auto callFunc = [this, rootPathItem]() { emit changeFolder(rootPathItem); };
+    auto callFunc = [this, rootPathItem]() { openRootPathEntry(rootPathItem); };
     QString name = rootPathItem.value("name");
 
     QPushButton* button = new QPushButton(name + "/", parentWidget);
@@ -304,6 +519,56 @@ void GirderFileBrowserDialog::updateRootPathWidget()
   scrollLeft->setEnabled(!rootButtonAdded);
 }
 
+void GirderFileBrowserDialog::editPath()
+{
+  QHBoxLayout* layout = m_ui->layout_rootPath;
+  while (QLayoutItem* item = layout->takeAt(0))
+  {
+    layout->removeWidget(item->widget());
+    item->widget()->deleteLater();
+  }
+
+  QLineEdit* pathEdit = new QLineEdit(currentPath(), layout->parentWidget());
+  pathEdit->setToolTip("A path such as /collection/Data/run42/raw. Press enter to go there.");
+  layout->addWidget(pathEdit);
+  pathEdit->setFocus();
+  pathEdit->selectAll();
+
+  connect(pathEdit, &QLineEdit::returnPressed, this, [this, pathEdit]() {
+    emit changePath(pathEdit->text());
+  });
+  // Bring the buttons back once the path is entered or abandoned
+  connect(
+    pathEdit, &QLineEdit::editingFinished, this, &GirderFileBrowserDialog::updateRootPathWidget);
+}
+
+QString GirderFileBrowserDialog::currentPath() const
+{
+  QStringList names;
+  for (const auto& info : m_currentRootPathInfo + QList<QMap<QString, QString> >{ m_currentParentInfo })
+  {
+    QString type = info.value("type");
+    if (type == "root")
+      continue;
+    else if (type == "Users")
+      names.append("user");
+    else if (type == "Collections")
+      names.append("collection");
+    else
+      names.append(info.value("name"));
+  }
+
+  return "/" + names.join('/');
+}
+
+void GirderFileBrowserDialog::openRootPathEntry(const QMap<QString, QString>& info)
+{
+  if (info.contains("path"))
+    emit changePath(info.value("path"));
+  else
+    emit changeFolder(info);
+}
+
 void GirderFileBrowserDialog::resizeEvent(QResizeEvent* event)
 {
   updateRootPathWidget();
@@ -313,20 +578,41 @@ void GirderFileBrowserDialog::resizeEvent(QResizeEvent* event)
 void GirderFileBrowserDialog::rowActivated(const QModelIndex& index)
 {
   int row = index.row();
-  if (row < m_cachedRowInfo.size())
-  {
-    QString parentType = m_cachedRowInfo[row].value("type", "unknown");
+  if (m_ui->check_searchIndex->isChecked())
+    openSearchResult(row);
+  else if (isFolderRow(row))
+    emit changeFolder(m_cachedRowInfo.at(row));
+}
 
-    QStringList folderTypes{ "root", "Users", "Collections", "user", "collection", "folder" };
+bool GirderFileBrowserDialog::isFolderRow(int row) const
+{
+  if (row < 0 || row >= m_cachedRowInfo.size())
+    return false;
 
-    // If we are to treat items as folders, add items to this list
-    using ItemMode = GirderFileBrowserFetcher::ItemMode;
-    if (m_girderFileBrowserFetcher->treatItemsAsFolders())
-      folderTypes.append("item");
+  QString parentType = m_cachedRowInfo.at(row).value("type", "unknown");
 
-    if (folderTypes.contains(parentType))
-      emit changeFolder(m_cachedRowInfo[row]);
-  }
+  QStringList folderTypes{ "root", "Users", "Collections", "user", "collection", "folder" };
+
+  // If we are to treat items as folders, add items to this list
+  if (m_girderFileBrowserFetcher->treatItemsAsFolders())
+    folderTypes.append("item");
+
+  return folderTypes.contains(parentType);
+}
+
+void GirderFileBrowserDialog::schedulePrefetch(const QModelIndex& index)
+{
+  if (!index.isValid() || !isFolderRow(index.row()))
+    return;
+
+  const QMap<QString, QString>& info = m_cachedRowInfo.at(index.row());
+  if (info == m_prefetchCandidate)
+    return;
+
+  // The mouse or the selection moved on
+  m_girderFileBrowserFetcher->cancelSpeculativePrefetches();
+  m_prefetchCandidate = info;
+  m_prefetchTimer->start();
 }
 
 void GirderFileBrowserDialog::goUpDirectory()
@@ -342,8 +628,10 @@ void GirderFileBrowserDialog::goUpDirectory()
   newParentInfo["name"] = m_currentRootPathInfo.back().value("name");
   newParentInfo["id"] = m_currentRootPathInfo.back().value("id");
   newParentInfo["type"] = m_currentRootPathInfo.back().value("type");
+  if (m_currentRootPathInfo.back().contains("path"))
+    newParentInfo["path"] = m_currentRootPathInfo.back().value("path");
 
-  emit changeFolder(newParentInfo);
+  openRootPathEntry(newParentInfo);
 }
 
 void GirderFileBrowserDialog::setItemMode(const QString& itemModeStr)
@@ -389,7 +677,7 @@ void GirderFileBrowserDialog::chooseObject()
   // We can only choose one object right now
   int row = list[0].row();
 
-  QMap<QString, QString> selectedRowInfo = m_cachedRowInfo[row];
+  QMap<QString, QString> selectedRowInfo = m_cachedRowInfo.at(row);
 
   // If this type is not choosable, just ignore it
   if (!m_choosableTypes.contains(selectedRowInfo["type"]))
@@ -401,7 +689,167 @@ void GirderFileBrowserDialog::chooseObject()
 void GirderFileBrowserDialog::changeVisibleRows(const QString& expression)
 {
   m_rowsMatchExpression = expression;
-  updateVisibleRows();
+  if (m_ui->check_searchIndex->isChecked())
+  {
+    showSearchResults();
+    m_searcher->search(expression);
+  }
+  else
+  {
+    updateVisibleRows();
+  }
+}
+
+void GirderFileBrowserDialog::setSearching(bool searching)
+{
+  if (searching)
+  {
+    showSearchResults();
+    m_searcher->searchNow(m_rowsMatchExpression);
+  }
+  else
+  {
+    m_searcher->cancel();
+    showRows(m_currentFolders, m_currentFiles);
+  }
+}
+
+void GirderFileBrowserDialog::showSearchResults()
+{
+  if (m_rowsMatchExpression.isEmpty())
+  {
+    showRows(m_currentFolders, m_currentFiles);
+    return;
+  }
+
+  // The names of the index are kept up to date as a crawl adds to it
+  const GirderTreeIndex& index = m_crawler->index();
+  QList<QMap<QString, QString> > folders;
+  QList<QMap<QString, QString> > files;
+  for (const QString& id : index.names().search(m_rowsMatchExpression))
+  {
+    GirderTreeIndex::Entry entry = index.entry(id);
+
+    QMap<QString, QString> info;
+    info["type"] = entry.type;
+    info["id"] = id;
+    info["name"] = entry.name;
+    info["location"] = entry.parentId.isEmpty() ? QString("/" + entry.type)
+                                                : index.path(entry.parentId);
+
+    if (entry.type == "file" || (entry.type == "item" && m_girderFileBrowserFetcher->treatItemsAsFiles()))
+      files.append(info);
+    else
+      folders.append(info);
+  }
+
+  // Then what the server found outside of the index. Their root paths are
+  // only asked for when they are shown, and for the first few.
+  const int maxResolvedLocations = 25;
+  int resolving = 0;
+  QList<QMap<QString, QString> > resolve;
+  if (m_searcher->query() == m_rowsMatchExpression.trimmed())
+  {
+    for (QMap<QString, QString> info : m_searcher->results())
+    {
+      QString id = info.value("id");
+      if (index.contains(id))
+        continue;
+
+      if (index.contains(info.value("parentId")))
+        info["location"] = index.path(info.value("parentId"));
+      else if (m_searcher->hasRootPath(id))
+        info["location"] = GirderSearcher::location(info, m_searcher->rootPath(info).result());
+      else if (resolving++ < maxResolvedLocations)
+        resolve.append(info);
+
+      if (info.value("type") == "item" && m_girderFileBrowserFetcher->treatItemsAsFiles())
+        files.append(info);
+      else
+        folders.append(info);
+    }
+  }
+
+  showRows(folders, files);
+
+  for (const auto& info : resolve)
+  {
+    QString id = info.value("id");
+    m_searcher->rootPath(info).subscribe(
+      [this, info, id](const QList<QMap<QString, QString> >& rootPath) {
+        setResultLocation(id, GirderSearcher::location(info, rootPath));
+      },
+      [](const QString&) {});
+  }
+}
+
+void GirderFileBrowserDialog::setResultLocation(const QString& id, const QString& location)
+{
+  if (!m_ui->check_searchIndex->isChecked())
+    return;
+
+  for (int row = 0; row < m_cachedRowInfo.size(); ++row)
+  {
+    const QMap<QString, QString>& info = m_cachedRowInfo.at(row);
+    if (info.value("id") != id || info.contains("location"))
+      continue;
+
+    if (QStandardItem* item = m_itemModel->item(row))
+      item->setText(QString("%1 (%2)").arg(info.value("name")).arg(location));
+    m_cachedRowInfo[row]["location"] = location;
+  }
+}
+
+void GirderFileBrowserDialog::openSearchResult(int row)
+{
+  if (row < 0 || row >= m_cachedRowInfo.size())
+    return;
+
+  QMap<QString, QString> object;
+  object["type"] = m_cachedRowInfo.at(row).value("type");
+  object["id"] = m_cachedRowInfo.at(row).value("id");
+  object["name"] = m_cachedRowInfo.at(row).value("name");
+
+  const GirderTreeIndex& index = m_crawler->index();
+  if (index.contains(object.value("id")))
+  {
+    openSearchResult(object, index.rootPath(object.value("id")));
+    return;
+  }
+
+  // A server result. Its root path may still have to be asked for.
+  setCursor(Qt::WaitCursor);
+  m_searcher->rootPath(object).subscribe(
+    [this, object](const QList<QMap<QString, QString> >& rootPath) {
+      setCursor(Qt::ArrowCursor);
+      openSearchResult(object, rootPath);
+    },
+    [this](const QString& message) { errorReceived(message); });
+}
+
+void GirderFileBrowserDialog::openSearchResult(const QMap<QString, QString>& object,
+  QList<QMap<QString, QString> > rootPath)
+{
+  QStringList folderTypes{ "user", "collection", "folder" };
+  if (m_girderFileBrowserFetcher->treatItemsAsFolders())
+    folderTypes.append("item");
+
+  // Files cannot be opened, so open where they are
+  QMap<QString, QString> target = object;
+  if (!folderTypes.contains(object.value("type")))
+  {
+    if (rootPath.isEmpty())
+      return;
+    target = rootPath.takeLast();
+  }
+
+  // The root path is known already, so the fetcher need not ask for it
+  m_girderFileBrowserFetcher->addRootPath(rootPath, target);
+
+  m_ui->check_searchIndex->blockSignals(true);
+  m_ui->check_searchIndex->setChecked(false);
+  m_ui->check_searchIndex->blockSignals(false);
+  emit changeFolder(target);
 }
 
 void GirderFileBrowserDialog::updateVisibleRows()
@@ -417,14 +865,15 @@ void GirderFileBrowserDialog::updateVisibleRows()
   showTypes += m_choosableTypes;
   for (size_t i = 0; i < m_cachedRowInfo.size(); ++i)
   {
-    if (!showTypes.contains(m_cachedRowInfo[i]["type"]))
+    if (!showTypes.contains(m_cachedRowInfo.at(i).value("type")))
     {
       m_ui->list_fileBrowser->setRowHidden(i, true);
     }
   }
 
   // Next, if there is a matching expression, hide all rows whose name does not match the expression
-  if (m_rowsMatchExpression.isEmpty())
+  // Search results already match.
+  if (m_rowsMatchExpression.isEmpty() || m_ui->check_searchIndex->isChecked())
     return;
 
   QRegularExpression regExp(
@@ -436,7 +885,7 @@ void GirderFileBrowserDialog::updateVisibleRows()
     if (m_ui->list_fileBrowser->isRowHidden(i))
       continue;
 
-    if (!regExp.match(m_cachedRowInfo[i]["name"]).hasMatch())
+    if (!regExp.match(m_cachedRowInfo.at(i).value("name")).hasMatch())
     {
       m_ui->list_fileBrowser->setRowHidden(i, true);
     }
@@ -451,47 +900,211 @@ void GirderFileBrowserDialog::finishChangingFolder(const QMap<QString, QString>&
   // Reset the root path offset when we change folders
   m_rootPathOffset = 0;
 
+  // The saved location, shown from the stored listings at startup, only
+  // has its rows updated, so the selection and the scroll position stay
+  bool inPlace = m_revalidatingLocation && newParentInfo == m_currentParentInfo;
+
   m_currentParentInfo = newParentInfo;
   m_currentRootPathInfo = rootPath;
+  m_currentFolders = folders;
+  m_currentFiles = files;
+
+  if (!inPlace)
+  {
+    // A new folder ends the search
+    m_searcher->cancel();
+    m_ui->check_searchIndex->blockSignals(true);
+    m_ui->check_searchIndex->setChecked(false);
+    m_ui->check_searchIndex->blockSignals(false);
+
+    showRows(folders, files);
+  }
+  else if (!m_ui->check_searchIndex->isChecked())
+  {
+    updateRows(folders, files);
+  }
+  updateRootPathWidget();
+
+  // Disable object choosing, unless a row is still selected
+  if (!inPlace || !m_ui->list_fileBrowser->selectionModel()->hasSelection())
+    m_ui->push_chooseObject->setEnabled(false);
+  setCursor(Qt::ArrowCursor);
+
+  m_revalidatingLocation = false;
+  saveLocation();
+  updateOfflineLabel();
+}
+
+void GirderFileBrowserDialog::updateFolderContents(const QMap<QString, QString>& parentInfo,
+  const QList<QMap<QString, QString> >& folders,
+  const QList<QMap<QString, QString> >& files)
+{
+  if (parentInfo != m_currentParentInfo)
+    return;
+
+  m_currentFolders = folders;
+  m_currentFiles = files;
+
+  // The rows are shown again when the search ends
+  if (m_ui->check_searchIndex->isChecked())
+    return;
+
+  updateRows(folders, files);
+  // The selected row may be gone
+  if (!m_ui->list_fileBrowser->selectionModel()->hasSelection())
+    m_ui->push_chooseObject->setEnabled(false);
+}
+
+void GirderFileBrowserDialog::updateRows(const QList<QMap<QString, QString> >& folders,
+  const QList<QMap<QString, QString> >& files)
+{
+  QList<QMap<QString, QString> > rows = folders + files;
+  int folderCount = folders.size();
+
+  // Keep the rows that are unchanged, still in the same section and still
+  // in order with the rows kept before them. Girder object ids are unique
+  // across types.
+  QHash<QString, int> newRows;
+  for (int row = 0; row < rows.size(); ++row)
+    newRows.insert(rows[row].value("id"), row);
+
+  int lastKept = -1;
+  QList<bool> kept;
+  for (int row = 0; row < m_cachedRowInfo.size(); ++row)
+  {
+    int newRow = newRows.value(m_cachedRowInfo.at(row).value("id"), -1);
+    bool keep = newRow > lastKept && rows[newRow] == m_cachedRowInfo.at(row) &&
+      m_itemModel->item(row)->icon().cacheKey() ==
+        (newRow < folderCount ? m_folderIcon : m_fileIcon)->cacheKey();
+    if (keep)
+      lastKept = newRow;
+    kept.append(keep);
+  }
+
+  for (int row = m_cachedRowInfo.size() - 1; row >= 0; --row)
+  {
+    if (!kept[row])
+    {
+      m_itemModel->removeRow(row);
+      m_cachedRowInfo.removeAt(row);
+    }
+  }
+
+  // What is left is in order, so fill in the gaps
+  for (int row = 0; row < rows.size(); ++row)
+  {
+    if (row < m_cachedRowInfo.size() && m_cachedRowInfo.at(row) == rows[row])
+      continue;
+
+    const QIcon& icon = row < folderCount ? *m_folderIcon : *m_fileIcon;
+    m_itemModel->insertRow(row, new QStandardItem(icon, rows[row].value("name")));
+    m_cachedRowInfo.insert(row, rows[row]);
+  }
+
+  updateVisibleRows();
+}
+
+void GirderFileBrowserDialog::showRows(const QList<QMap<QString, QString> >& folders,
+  const QList<QMap<QString, QString> >& files)
+{
+  // The rows are about to change
+  m_prefetchTimer->stop();
+  m_prefetchCandidate.clear();
 
   size_t numRows = folders.size() + files.size();
   m_itemModel->setRowCount(numRows);
   m_itemModel->setColumnCount(1);
 
-  m_cachedRowInfo.clear();
-
   int currentRow = 0;
 
+  // Search results also tell where they are
+  auto rowText = [](const QMap<QString, QString>& info) {
+    if (!info.contains("location"))
+      return info.value("name");
+    return QString("%1 (%2)").arg(info.value("name")).arg(info.value("location"));
+  };
+
   // Folders
   for (int i = 0; i < folders.size(); ++i)
   {
-    QString name = folders[i].value("name");
-
-    m_itemModel->setItem(currentRow, 0, new QStandardItem(*m_folderIcon, name));
-    m_cachedRowInfo.append(folders[i]);
+    m_itemModel->setItem(currentRow, 0, new QStandardItem(*m_folderIcon, rowText(folders[i])));
     ++currentRow;
   }
 
   // Files
   for (int i = 0; i < files.size(); ++i)
   {
-    QString name = files[i].value("name");
-
-    m_itemModel->setItem(currentRow, 0, new QStandardItem(*m_fileIcon, name));
-    m_cachedRowInfo.append(files[i]);
+    m_itemModel->setItem(currentRow, 0, new QStandardItem(*m_fileIcon, rowText(files[i])));
     ++currentRow;
   }
 
-  updateVisibleRows();
-  updateRootPathWidget();
+  // The rows are shared with the fetcher, not copied
+  m_cachedRowInfo = folders;
+  if (!files.isEmpty())
+    m_cachedRowInfo += files;
 
-  // Disable object choosing
+  updateVisibleRows();
   m_ui->push_chooseObject->setEnabled(false);
-  setCursor(Qt::ArrowCursor);
+}
+
+static QString describeAge(qint64 msecs)
+{
+  qint64 minutes = msecs / (60 * 1000);
+  if (minutes < 1)
+    return "less than a minute";
+  if (minutes < 120)
+    return QString("%1 minutes").arg(minutes);
+  if (minutes < 48 * 60)
+    return QString("%1 hours").arg(minutes / 60);
+  return QString("%1 days").arg(minutes / (24 * 60));
+}
+
+void GirderFileBrowserDialog::updateOfflineLabel()
+{
+  if (!m_girderFileBrowserFetcher->isOffline())
+  {
+    m_ui->label_offline->hide();
+    return;
+  }
+
+  QString text = "Offline";
+  qint64 age = m_girderFileBrowserFetcher->offlineListingAge();
+  if (age >= 0)
+    text += QString(": this listing was stored %1 ago").arg(describeAge(age));
+  m_ui->label_offline->setText(text);
+  m_ui->label_offline->show();
+}
+
+void GirderFileBrowserDialog::setOffline(bool offline)
+{
+  m_girderFileBrowserFetcher->setOffline(offline);
 }
 
 void GirderFileBrowserDialog::errorReceived(const QString& message)
 {
+  // Offline, what could not be shown is not worth a dialog. The current
+  // listing stays.
+  if (m_girderFileBrowserFetcher->isOffline())
+  {
+    setCursor(Qt::ArrowCursor);
+    m_revalidatingLocation = false;
+    qDebug() << "Offline:\n" << message;
+    m_ui->label_offline->setText("Offline: " + message);
+    m_ui->label_offline->show();
+    return;
+  }
+
+  // The saved location may have been deleted or made private since. Start
+  // from the root instead.
+  if (m_revalidatingLocation)
+  {
+    qDebug() << "Failed to refresh the last location:\n" << message;
+    m_revalidatingLocation = false;
+    forgetLocation();
+    emit changeFolder(m_rootFolder);
+    return;
+  }
+
   setCursor(Qt::ArrowCursor);
   qDebug() << "An error occurred:\n" << message;
   QMessageBox::critical(this, "An Error Occurred:", message);
@@ -499,12 +1112,29 @@ void GirderFileBrowserDialog::errorReceived(const QString& message)
 
 void GirderFileBrowserDialog::setApiUrl(const QString& url)
 {
+  m_apiUrl = url;
   m_girderFileBrowserFetcher->setApiUrl(url);
+  m_crawler->setApiUrl(url);
+  m_searcher->setApiUrl(url);
 }
 
 void GirderFileBrowserDialog::setGirderToken(const QString& token)
 {
   m_girderFileBrowserFetcher->setGirderToken(token);
+  m_crawler->setGirderToken(token);
+  m_searcher->setGirderToken(token);
+}
+
+void GirderFileBrowserDialog::indexCurrentFolder()
+{
+  // The top levels are not girder objects
+  if (currentParentId().isEmpty())
+  {
+    qDebug() << "Only users, collections, folders, and items can be indexed.";
+    return;
+  }
+
+  m_crawler->crawl(m_currentParentInfo);
 }
 
 void GirderFileBrowserDialog::setApiUrlAndGirderToken(const QString& url, const QString& token)
@@ -25,6 +25,7 @@ class QModelIndex;
 class QNetworkAccessManager;
 class QResizeEvent;
 class QStandardItemModel;
+class QTimer;
 
 namespace Ui
 {
@@ -34,7 +35,9 @@ class GirderFileBrowserDialog;
 namespace cumulus
 {
 
+class GirderCrawler;
 class GirderFileBrowserFetcher;
+class GirderSearcher;
 
 class GirderFileBrowserDialog : public QDialog
 {
@@ -65,13 +68,33 @@ signals:
   // objectInfo should contain "name", "id", and "type".
   void objectChosen(const QMap<QString, QString>& objectInfo);
 
+  // Emitted when the server rejected the girder token. Authenticate again,
+  // then call setApiUrlAndGirderToken() and begin().
+  void authenticationRequired();
+
+  // Steps from begin() to the first listing, with msecs since begin()
+  void startupTrace(const QString& event, qint64 msecs);
+
+  // How well prefetching works: the listings prefetched, how many of them
+  // were used, and the bytes of the used and of the wasted ones
+  void prefetchStatistics(int issued, int hits, qint64 usedBytes, qint64 wastedBytes);
+
+  // Progress of indexCurrentFolder(): the objects listed so far, and
+  // those left to list
+  void indexProgress(int crawled, int pending);
+  void indexFinished();
+
   // The following signals are used internally only:
   void changeFolder(const QMap<QString, QString>& parentInfo);
+  void changePath(const QString& path);
   void goHome();
 
 public slots:
   // Call this when the api url and girder token are set, and browsing
-  // is ready to start.
+  // is ready to start. Everything the first listing may need is requested
+  // right away. If a location was saved for this server by an earlier
+  // session, it is shown at once from the saved listing, and refreshed
+  // in the background.
   void begin();
 
   // A convenience function for authentication success
@@ -84,6 +107,14 @@ public slots:
   // and "Treat Items as Folders with File Bumping".
   void setItemMode(const QString& text);
 
+  // Crawl everything below the current folder in the background, and keep
+  // it in a local index. An interrupted crawl is resumed by begin().
+  void indexCurrentFolder();
+
+  // Browse only what was stored by earlier listings. This also happens by
+  // itself while the server cannot be reached.
+  void setOffline(bool offline);
+
 protected:
   void resizeEvent(QResizeEvent* event) override;
 
@@ -96,12 +127,61 @@ private slots:
     const QList<QMap<QString, QString> >& folders,
     const QList<QMap<QString, QString> >& files,
     const QList<QMap<QString, QString> >& rootPath);
+  // Only update the rows that changed, keeping the selection
+  void updateFolderContents(const QMap<QString, QString>& parentInfo,
+    const QList<QMap<QString, QString> >& folders,
+    const QList<QMap<QString, QString> >& files);
 
   void errorReceived(const QString& message);
 
 private:
   void updateRootPathWidget();
   void updateVisibleRows();
+  // Show whether we are offline, and how old the listing is
+  void updateOfflineLabel();
+
+  // Fill the list with these rows
+  void showRows(const QList<QMap<QString, QString> >& folders,
+    const QList<QMap<QString, QString> >& files);
+  // The same, only adding and removing the rows that differ from the ones
+  // shown
+  void updateRows(const QList<QMap<QString, QString> >& folders,
+    const QList<QMap<QString, QString> >& files);
+
+  // Show the objects of the crawler's index whose name contains the filter
+  // text, followed by what the server found that is not indexed, with
+  // where they are. Activating one opens it, or the folder it is in.
+  void showSearchResults();
+  void openSearchResult(int row);
+  void openSearchResult(const QMap<QString, QString>& object,
+    QList<QMap<QString, QString> > rootPath);
+  void setSearching(bool searching);
+  // Show where the result with id is, once its root path is known
+  void setResultLocation(const QString& id, const QString& location);
+
+  // Replace the root path buttons with a line edit for typing a path
+  void editPath();
+  // The girder path of the current folder, such as /user/jdoe/Public.
+  // With a custom root, it starts at that root instead.
+  QString currentPath() const;
+
+  // Root path entries built from a typed path have no id yet, only a path
+  void openRootPathEntry(const QMap<QString, QString>& info);
+
+  // Can the row be entered?
+  bool isFolderRow(int row) const;
+
+  // Prefetch the folder at index if the mouse or the selection stays on
+  // it for a moment
+  void schedulePrefetch(const QModelIndex& index);
+
+  // The last location and its root path are saved in the user settings,
+  // per server and root folder, every time the folder changes
+  QString locationSettingsGroup() const;
+  void saveLocation();
+  bool loadLocation(QMap<QString, QString>& parentInfo,
+    QList<QMap<QString, QString> >& rootPath) const;
+  void forgetLocation();
 
   // Convenience functions...
   QString currentParentName() const { return m_currentParentInfo.value("name"); }
@@ -113,10 +193,17 @@ private:
   std::unique_ptr<Ui::GirderFileBrowserDialog> m_ui;
   std::unique_ptr<QStandardItemModel> m_itemModel;
   std::unique_ptr<GirderFileBrowserFetcher> m_girderFileBrowserFetcher;
+  std::unique_ptr<GirderCrawler> m_crawler;
+  std::unique_ptr<GirderSearcher> m_searcher;
 
   // Have we started yet?
   bool m_hasStarted = false;
 
+  // Set while the saved location shown by begin() is being refreshed
+  bool m_revalidatingLocation = false;
+
+  QString m_apiUrl;
+
   QMap<QString, QString> m_currentParentInfo;
 
   // What is the root info?
@@ -136,17 +223,19 @@ private:
   QList<QMap<QString, QString> > m_cachedRowInfo;
   QList<QMap<QString, QString> > m_currentRootPathInfo;
 
+  // The rows of the current folder, shown again when a search ends
+  QList<QMap<QString, QString> > m_currentFolders;
+  QList<QMap<QString, QString> > m_currentFiles;
+
+  // The folder that will be prefetched when m_prefetchTimer fires
+  std::unique_ptr<QTimer> m_prefetchTimer;
+  QMap<QString, QString> m_prefetchCandidate;
+
   // Our icons that we use
   std::unique_ptr<QIcon> m_folderIcon;
   std::unique_ptr<QIcon> m_fileIcon;
 };
 
-inline void GirderFileBrowserDialog::begin()
-{
-  m_hasStarted = true;
-  emit changeFolder(m_rootFolder);
-}
-
 } // end of namespace
 
 #endif